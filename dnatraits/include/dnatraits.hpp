@@ -7,7 +7,9 @@
 #define INC_DNATRAITS_H
 
 #include <cstdint>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <vector>
 #include <string>
 
@@ -16,6 +18,11 @@
 typedef std::uint32_t Position;
 typedef std::uint32_t RSID;
 
+/*
+ * 23andMe's internal IDs, without the "i" prefix.
+ */
+typedef std::uint32_t InternalID;
+
 enum Nucleotide {
   NONE, A, G, C, T, D, I
 };
@@ -74,9 +81,9 @@ struct DLL_PUBLIC SNP {
   SNP(const Chromosome& = NO_CHR,
       const Position& = 0,
       const Genotype& = NN);
-  SNP(const SNP&);
+  SNP(const SNP&) = default;
 
-  SNP& operator=(const SNP&);
+  SNP& operator=(const SNP&) = default;
   bool operator!=(const SNP&) const;
   bool operator<(const SNP&) const;
   bool operator<=(const SNP&) const;
@@ -88,8 +95,100 @@ struct DLL_PUBLIC SNP {
 
 extern DLL_PUBLIC const SNP NONE_SNP;
 
+/*!
+ * A SNP packed into one aligned 64-bit word. The genotype is stored as a
+ * 5-bit code that disregards the order of the nucleotides (see
+ * util/genopairs.py), followed by 5 bits of chromosome and 28 bits of
+ * position. Code zero means "not in genome", so a zeroed record is empty.
+ *
+ * Ordering the words as integers orders by position, then chromosome, then
+ * genotype code.
+ */
+#pragma pack(push, 8)
+struct DLL_PUBLIC PackedSNP {
+  std::uint64_t bits;
+
+  PackedSNP() : bits(0)
+  {
+  }
+
+  /*!
+   * Packs a SNP. Throws if the position doesn't fit in 28 bits.
+   */
+  explicit PackedSNP(const SNP&);
+
+  /*!
+   * Unpacks the SNP. The nucleotides come in alphabetical order, except
+   * that a no-call goes second, as the parsers store haploid calls.
+   */
+  SNP snp() const;
+
+  inline unsigned code() const {
+    return static_cast<unsigned>(bits & 0x1f);
+  }
+
+  inline Chromosome chromosome() const {
+    return static_cast<Chromosome>((bits >> 5) & 0x1f);
+  }
+
+  inline Position position() const {
+    return static_cast<Position>((bits >> 10) & 0xfffffff);
+  }
+
+  inline bool empty() const {
+    return code() == 0;
+  }
+
+  Genotype genotype() const;
+
+  /*!
+   * The code of a genotype. AG and GA get the same one.
+   */
+  static unsigned code(const Genotype&);
+
+  /*!
+   * Same record with the genotype complemented.
+   */
+  PackedSNP operator~() const;
+
+  /*!
+   * Compares the genotype, disregarding the order of the nucleotides.
+   */
+  bool operator==(const Genotype&) const;
+
+  inline bool operator==(const PackedSNP& o) const {
+    return bits == o.bits;
+  }
+
+  inline bool operator!=(const PackedSNP& o) const {
+    return bits != o.bits;
+  }
+
+  inline bool operator<(const PackedSNP& o) const {
+    return bits < o.bits;
+  }
+};
+#pragma pack(pop)
+
 struct DLL_LOCAL GenomeIteratorImpl;
 
+/*!
+ * How a genome keeps its SNPs.
+ */
+enum Storage {
+  /*!
+   * A hash table. Fastest to build and to look up in.
+   */
+  STORAGE_HASH,
+
+  /*!
+   * Compressed, sorted RSIDs with the SNPs in a parallel array. Takes a
+   * fraction of the memory, and iterates in RSID order, at the price of
+   * somewhat slower lookups. Inserts are buffered until compact().
+   */
+  STORAGE_SORTED
+};
+
 struct DLL_PUBLIC RsidSNP {
   RSID rsid;
   SNP snp;
@@ -100,20 +199,55 @@ struct DLL_PUBLIC RsidSNP {
   }
 };
 
+/*!
+ * Iterates over the SNPs of a genome. Iterators don't allocate, so they're
+ * cheap to create and copy. Dereferencing gives a reference to the current
+ * RSID and SNP, which is valid until the iterator is advanced.
+ */
+#pragma pack(push, 8)
 struct DLL_PUBLIC GenomeIterator {
-  // todo copy ctor, assignment op, dtor
-  GenomeIterator(GenomeIteratorImpl*);
+  typedef std::forward_iterator_tag iterator_category;
+  typedef RsidSNP value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef const RsidSNP* pointer;
+  typedef const RsidSNP& reference;
+
+  GenomeIterator(const GenomeIteratorImpl&);
   ~GenomeIterator();
   GenomeIterator(const GenomeIterator&);
   GenomeIterator& operator=(const GenomeIterator&);
   GenomeIterator& operator++();
-  bool operator==(const GenomeIterator&);
-  bool operator!=(const GenomeIterator&);
-  const RsidSNP operator*();
+  bool operator==(const GenomeIterator&) const;
+  bool operator!=(const GenomeIterator&) const;
+  const RsidSNP& operator*();
+  const RsidSNP* operator->();
 private:
-  GenomeIteratorImpl* pimpl;
+  // Holds a GenomeIteratorImpl in place, instead of on the heap
+  alignas(8) unsigned char state[48];
+  RsidSNP current;
+
+  GenomeIteratorImpl& impl();
+  const GenomeIteratorImpl& impl() const;
+};
+#pragma pack(pop)
+
+/*!
+ * A run of SNPs ordered by chromosome and position, with their RSIDs in a
+ * parallel array. It points into the genome, and is only valid until the
+ * genome is modified.
+ */
+struct DLL_PUBLIC SNPSpan {
+  const RSID* rsids;
+  const SNP* snps;
+  size_t size;
+
+  inline bool empty() const {
+    return size == 0;
+  }
 };
 
+struct DLL_PUBLIC GenomeColumns;
+
 struct DLL_PUBLIC Genome {
   /*!
    * True if genome contains a Y-chromosome (with non-empty genotypes).
@@ -130,16 +264,42 @@ struct DLL_PUBLIC Genome {
    */
   RSID last;
 
-  Genome(const size_t size);
+  /*!
+   * Creates an empty genome with room for the given number of SNPs.
+   */
+  Genome(const size_t size = 0, const Storage storage = STORAGE_HASH);
   Genome(const Genome&);
   Genome& operator=(const Genome&);
   ~Genome();
 
+  /*!
+   * Moves the contents without copying or allocating. A moved-from genome
+   * is left empty, with the default storage, and can be reused.
+   */
+  Genome(Genome&&) noexcept;
+  Genome& operator=(Genome&&) noexcept;
+
   /*!
    * Access SNP. Throws on not found.
    */
   const SNP& operator[](const RSID& id) const;
 
+  /*!
+   * Looks up many RSIDs at once. For each rsids[n], out[n] is set to its
+   * SNP, or NONE_SNP if it's missing, and found[n] to whether it was found,
+   * unless found is NULL. Returns the number found.
+   *
+   * The RSIDs are looked up in the order given, a small group at a time,
+   * with the stages of each group's lookups overlapped so that their cache
+   * misses do too. How much of a lookup that covers depends on the storage:
+   * with STORAGE_SORTED, the filter and the packed blocks are prefetched;
+   * with STORAGE_HASH, only the filter is, which mostly speeds up missing
+   * RSIDs; and genomes loaded or attached from snapshots run their binary
+   * searches in lockstep, prefetching each step.
+   */
+  size_t lookup(const RSID* rsids, const size_t count, SNP* out,
+                bool* found = NULL) const;
+
   /*!
    * Checks if hash table contains given RSID.
    */
@@ -150,6 +310,64 @@ struct DLL_PUBLIC Genome {
    */
   void insert(const RSID& rsid, const SNP& snp);
 
+  /*!
+   * Add count SNPs in one go. The hash table grows at most once, sorted
+   * storage merges a large batch with a single sort, and the filter and
+   * position index are updated once. As with insert, existing RSIDs are
+   * left alone, and of repeated ones in the batch the first is kept.
+   */
+  void insert_many(const RSID* rsids, const SNP* snps, const size_t count);
+
+  /*!
+   * Make room for a total of size SNPs, so inserting up to that many won't
+   * rehash.
+   */
+  void reserve(const size_t size);
+
+  /*!
+   * With STORAGE_SORTED, merges SNPs inserted since the last call into the
+   * sorted arrays. The parsers do this when they're done. Lookups see new
+   * SNPs either way, so this only saves memory.
+   */
+  void compact();
+
+  /*!
+   * How the SNPs are kept.
+   */
+  Storage storage() const;
+
+  /*!
+   * Builds a Bloom filter over the RSIDs, so looking up ones that aren't in
+   * the genome can usually skip the table. The parsers do this when they're
+   * done, and inserts keep it up to date.
+   */
+  void build_filter();
+
+  /*!
+   * Drops the Bloom filter. (For developer purposes)
+   */
+  void drop_filter();
+
+  /*!
+   * Access SNP with a 23andMe internal ID. Returns NONE_SNP if not found.
+   */
+  const SNP& internal(const InternalID& id) const;
+
+  /*!
+   * Checks if genome contains given internal ID.
+   */
+  bool has_internal(const InternalID& id) const;
+
+  /*!
+   * Add a SNP with an internal ID. These are kept in a table of their own.
+   */
+  void insert_internal(const InternalID& id, const SNP& snp);
+
+  /*!
+   * Number of SNPs with internal IDs. These aren't counted by size().
+   */
+  size_t internal_size() const;
+
   /*!
    * Underlying hash table's load factor. (For developer purposes)
    */
@@ -161,14 +379,35 @@ struct DLL_PUBLIC Genome {
   size_t size() const;
 
   /*!
-   * Returns RSIDs that exist in both genomes.
+   * Returns RSIDs that exist in both genomes, in sorted order.
+   *
+   * When both genomes are fully sorted (STORAGE_SORTED and compacted, or
+   * loaded from a snapshot), their RSID arrays are merged directly, using
+   * the given number of threads. Zero threads means one per core.
+   * Otherwise, as with STORAGE_HASH, each RSID of this genome is looked up
+   * in the other on the calling thread, and threads is ignored.
+   */
+  std::vector<RSID> intersect_rsid(const Genome& genome,
+                                   const unsigned threads = 1) const;
+
+  /*!
+   * Returns RSID for SNPs that have the same genotype in both genomes, in
+   * sorted order.
+   */
+  std::vector<RSID> intersect_snp(const Genome& genome,
+                                  const unsigned threads = 1) const;
+
+  /*!
+   * Like intersect_rsid(), but only counts the RSIDs.
    */
-  std::vector<RSID> intersect_rsid(const Genome& genome) const;
+  size_t intersect_rsid_count(const Genome& genome,
+                              const unsigned threads = 1) const;
 
   /*!
-   * Returns RSID for SNPs that have the same genotype in both genomes.
+   * Like intersect_snp(), but only counts the RSIDs.
    */
-  std::vector<RSID> intersect_snp(const Genome& genome) const;
+  size_t intersect_snp_count(const Genome& genome,
+                             const unsigned threads = 1) const;
 
   /*!
    * Returns all RSIDs in this genome.
@@ -180,23 +419,580 @@ struct DLL_PUBLIC Genome {
    */
   std::vector<SNP> snps() const;
 
+  /*!
+   * Returns internal IDs that exist in both genomes, in sorted order.
+   */
+  std::vector<InternalID> intersect_internal(const Genome& genome) const;
+
+  /*!
+   * Returns all internal IDs in this genome.
+   */
+  std::vector<InternalID> internal_ids() const;
+
+  /*!
+   * Returns a columnar copy of the SNPs, sorted by RSID, for fast scans.
+   */
+  GenomeColumns columns() const;
+
+  /*!
+   * Returns the SNPs on the given chromosome with positions in [start, end),
+   * ordered by position. The first call builds an index, which is shared
+   * between copies and dropped when the genome is modified. After that,
+   * calls are a couple of binary searches and don't allocate.
+   */
+  SNPSpan find(const Chromosome chromosome,
+               const Position start = 0,
+               const Position end = 0xffffffff) const;
+
+  /*!
+   * Writes the genome to a binary snapshot file, which can be read back with
+   * load().
+   */
+  void save(const std::string& filename) const;
+
+  /*!
+   * Replaces contents with those of a snapshot file written by save(). The
+   * file is memory mapped and used in place, so there is no per-SNP work. If
+   * verify is set, the checksum of the whole file is checked. The genome is
+   * copied into a regular hash map on the first insert.
+   */
+  void load(const std::string& filename, const bool verify = false);
+
+  /*!
+   * Publishes the genome as a snapshot in a POSIX shared memory object with
+   * the given name, which should start with a slash. Other processes can
+   * then attach() to it. An existing object with the same name is replaced.
+   * The object stays until unpublish() is called or the system restarts.
+   */
+  void publish(const std::string& name) const;
+
+  /*!
+   * Replaces contents with those of a published genome. The shared pages
+   * are mapped read-only and used in place, like load() does with files, so
+   * any number of processes can attach without copying.
+   */
+  void attach(const std::string& name, const bool verify = false);
+
+  /*!
+   * Removes a published genome. Those attached to it keep their mapping.
+   * Returns false if there was none.
+   */
+  static bool unpublish(const std::string& name);
+
   bool operator==(const Genome&) const;
   bool operator!=(const Genome&) const;
 
   GenomeIterator begin() const;
   GenomeIterator end() const;
 
+  /*!
+   * Iterates over the SNPs with internal IDs.
+   */
+  GenomeIterator internal_begin() const;
+  GenomeIterator internal_end() const;
+
 private:
   struct DLL_LOCAL GenomeImpl;
   GenomeImpl* pimpl;
+
+  GenomeImpl& impl();
+  const GenomeImpl& impl() const;
+};
+
+/*!
+ * The SNPs of a genome as separate, contiguous arrays, sorted by RSID.
+ * Genotypes are stored as PackedSNP codes, so they can be matched against
+ * a set of codes, given as a bitmask. Scans run over whole vector registers
+ * at a time.
+ */
+struct DLL_PUBLIC GenomeColumns {
+  std::vector<RSID> rsids;
+  std::vector<std::uint8_t> chromosomes;
+  std::vector<Position> positions;
+  std::vector<std::uint8_t> genotypes;
+
+  /*!
+   * Number of SNPs.
+   */
+  size_t size() const;
+
+  /*!
+   * The SNP at the given index.
+   */
+  SNP snp(const size_t index) const;
+
+  /*!
+   * Number of SNPs on the given chromosome.
+   */
+  size_t count(const Chromosome) const;
+
+  /*!
+   * RSIDs of the SNPs on the given chromosome.
+   */
+  std::vector<RSID> select(const Chromosome) const;
+
+  /*!
+   * Number of SNPs with a genotype in the given set of codes.
+   */
+  size_t count_genotypes(const std::uint32_t codes) const;
+
+  /*!
+   * RSIDs of the SNPs with a genotype in the given set of codes.
+   */
+  std::vector<RSID> select_genotypes(const std::uint32_t codes) const;
+
+  /*!
+   * Genotype code sets. A no-call is "--", while half calls, such as on the
+   * Y chromosome, are neither homozygous nor heterozygous.
+   */
+  static std::uint32_t no_calls();
+  static std::uint32_t homozygous();
+  static std::uint32_t heterozygous();
 };
 
 Nucleotide complement(const Nucleotide& n);
 
 /*!
- * Parse a 23andMe genome text file and put contents into genome.
+ * Genome file formats understood by the parsers.
+ */
+enum FileFormat {
+  FORMAT_AUTO,        //!< Detect from the contents
+  FORMAT_23ANDME,
+  FORMAT_ANCESTRYDNA,
+  FORMAT_CSV,         //!< FamilyTreeDNA and MyHeritage
+  FORMAT_VCF          //!< First sample of a VCF file
+};
+
+/*!
+ * Access hints for memory mapped input files. They may be combined.
+ */
+enum MapAdvice {
+  ADVISE_NONE = 0,
+  ADVISE_SEQUENTIAL = 1, //!< Read ahead aggressively (best with one thread)
+  ADVISE_WILLNEED = 2,   //!< Start reading the whole file in right away
+  ADVISE_POPULATE = 4,   //!< Fault in all pages before parsing (Linux)
+  ADVISE_HUGEPAGES = 8   //!< Ask for transparent huge pages (Linux)
+};
+
+/*!
+ * A record that was rejected while validating input.
  */
-void parse_file(const std::string& filename, Genome&);
+struct DLL_PUBLIC ParseError {
+  /*!
+   * Line number, counting from one.
+   */
+  size_t line;
+
+  /*!
+   * What was wrong with it.
+   */
+  std::string reason;
+
+  ParseError(const size_t line, const std::string& reason);
+};
+
+/*!
+ * Options for parse_file.
+ */
+struct DLL_PUBLIC ParseOptions {
+  /*!
+   * Number of threads to parse with. Zero means one per hardware thread.
+   * Small files are always parsed by the calling thread alone.
+   */
+  unsigned threads;
+
+  /*!
+   * Format of the input. By default, it's detected from the first lines.
+   */
+  FileFormat format;
+
+  /*!
+   * If set, each record is validated. Bad ones are skipped, and their line
+   * numbers and the reasons are appended here. Otherwise, the input is
+   * trusted, and parsing takes no extra time.
+   */
+  std::vector<ParseError>* errors;
+
+  /*!
+   * MapAdvice flags for parse_file. None are given by default.
+   */
+  unsigned advice;
+
+  ParseOptions(const unsigned threads = 1,
+               const FileFormat format = FORMAT_AUTO);
+};
+
+/*!
+ * Guess the format of a genome file from its leading bytes.
+ */
+FileFormat detect_format(const char* data, const size_t size);
+
+/*!
+ * Parse a genome text file and put contents into genome. Files from
+ * 23andMe, AncestryDNA, FamilyTreeDNA and MyHeritage are accepted, as are
+ * VCF files, and may be gzipped or zipped.
+ */
+void parse_file(const std::string& filename, Genome&,
+                const ParseOptions& options = ParseOptions());
+
+/*!
+ * Start reading a file into the page cache in the background, and return
+ * right away. Call it for the next few files while parsing one, so they're
+ * already in memory when their turn comes. Returns false if the file
+ * couldn't be opened.
+ */
+bool prefetch_file(const std::string& filename);
+
+/*!
+ * Parse a genome from memory and put contents into genome. The
+ * buffer doesn't have to be NUL-terminated, and is only read from.
+ */
+void parse_buffer(const char* data, const size_t size, Genome&,
+                  const ParseOptions& options = ParseOptions());
+
+/*!
+ * Parse a genome from a file descriptor, until end of file. This
+ * works for pipes, sockets and standard input as well, and the data may be
+ * gzipped or zipped. Decompression runs in a separate thread while parsing,
+ * and each chunk of the stream is parsed with the given number of threads.
+ */
+void parse_stream(const int fd, Genome&,
+                  const ParseOptions& options = ParseOptions());
+
+struct DLL_PUBLIC CohortSample;
+struct DLL_PUBLIC PolygenicScore;
+
+/*!
+ * Identity by state between two samples: the number of markers called in
+ * both where they share no alleles, one, or both.
+ */
+struct DLL_PUBLIC IBSCounts {
+  std::uint32_t ibs0;
+  std::uint32_t ibs1;
+  std::uint32_t ibs2;
+};
+
+/*!
+ * A polygenic score for one sample: the sum of the weights times the number
+ * of effect alleles, and the number of variants that had a usable call.
+ */
+struct DLL_PUBLIC ScoreSum {
+  double sum;
+  std::uint32_t variants;
+};
+
+/*!
+ * Genotypes of many samples over one shared dictionary of markers. Each
+ * marker's RSID, chromosome and position are stored once, and each sample
+ * only keeps two bits per marker. The first two alleles seen for a marker
+ * give the codes no call, homozygous for the first, heterozygous, and
+ * homozygous for the second. The rare genotypes that don't fit, such as a
+ * third allele, are kept on the side, so nothing is lost.
+ *
+ * Markers are taken from the samples as they're added. Internal IDs are not
+ * kept, and a SNP that's missing from a sample can't be told apart from a
+ * no-call.
+ */
+struct DLL_PUBLIC Cohort {
+  static const size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  Cohort();
+  Cohort(const Cohort&);
+  Cohort& operator=(const Cohort&);
+
+  /*!
+   * Moves the samples without copying or allocating. A moved-from cohort
+   * is left empty, and can be reused.
+   */
+  Cohort(Cohort&&) noexcept;
+  Cohort& operator=(Cohort&&) noexcept;
+
+  ~Cohort();
+
+  /*!
+   * Adds a sample, and returns its index.
+   */
+  size_t add(const Genome& genome);
+
+  /*!
+   * Parses the files, the given number at a time, and adds them as samples
+   * in order. The next files are prefetched while parsing. Zero threads
+   * means one per hardware thread.
+   */
+  void add_files(const std::vector<std::string>& filenames,
+                 const unsigned threads = 1,
+                 const ParseOptions& options = ParseOptions());
+
+  /*!
+   * Number of samples.
+   */
+  size_t size() const;
+
+  /*!
+   * Number of markers.
+   */
+  size_t markers() const;
+
+  /*!
+   * Index of the marker with the given RSID, or NOT_FOUND.
+   */
+  size_t marker(const RSID& rsid) const;
+
+  RSID rsid(const size_t marker) const;
+  Chromosome chromosome(const size_t marker) const;
+  Position position(const size_t marker) const;
+
+  /*!
+   * The genotype of a sample at a marker.
+   */
+  Genotype genotype(const size_t sample, const size_t marker) const;
+
+  /*!
+   * A view of the given sample.
+   */
+  CohortSample operator[](const size_t sample) const;
+
+  /*!
+   * Identity by state between all pairs of samples, as a dense matrix with
+   * one row per sample. Only diploid markers are counted, and genotypes
+   * that don't fit in two bits are skipped.
+   *
+   * Genotypes are split into bit planes, so that 64 markers are compared
+   * with a few logic operations and popcounts. Pairs are worked on in
+   * tiles, spread over the given number of threads. Zero threads means one
+   * per hardware thread.
+   */
+  std::vector<IBSCounts> ibs(const unsigned threads = 1) const;
+
+  /*!
+   * Like ibs(), but calls f(i, j, counts) for each pair with i < j instead
+   * of storing the matrix. Calls are made one at a time, but in no
+   * particular order.
+   */
+  void ibs(const std::function<void(size_t, size_t, const IBSCounts&)>& f,
+           const unsigned threads = 1) const;
+
+  /*!
+   * Polygenic scores of all samples. The variants are resolved to markers
+   * once, and each marker's four genotype codes are turned into weighted
+   * dosages, so scoring a sample is a table lookup per variant. Samples are
+   * split over the given number of threads. Zero threads means one per
+   * hardware thread.
+   */
+  std::vector<ScoreSum> score(const PolygenicScore& model,
+                              const unsigned threads = 1) const;
+
+  /*!
+   * Approximate number of bytes used.
+   */
+  size_t memory() const;
+
+private:
+  struct DLL_LOCAL CohortImpl;
+  CohortImpl* pimpl;
+
+  CohortImpl& impl();
+  const CohortImpl& impl() const;
+};
+
+/*!
+ * One sample of a cohort, with the lookups of a Genome. It refers to the
+ * cohort, which must outlive it and not be modified while it's in use.
+ */
+struct DLL_PUBLIC CohortSample {
+  CohortSample(const Cohort& cohort, const size_t index);
+
+  /*!
+   * Returns the SNP with the given RSID, or NONE_SNP if the marker is
+   * unknown.
+   */
+  SNP operator[](const RSID& rsid) const;
+
+  /*!
+   * True if the sample has a call for the given RSID.
+   */
+  bool has(const RSID& rsid) const;
+
+  /*!
+   * Number of SNPs with calls.
+   */
+  size_t size() const;
+
+  /*!
+   * RSIDs with calls, in sorted order.
+   */
+  std::vector<RSID> rsids() const;
+
+  /*!
+   * Returns a copy of the sample as a standalone genome.
+   */
+  Genome genome(const Storage storage = STORAGE_SORTED) const;
+
+private:
+  const Cohort* cohort;
+  size_t index;
+};
+
+/*!
+ * Genotype rules, compiled for evaluating against many genomes. A rule
+ * set is written as text, with one rule per line:
+ *
+ *   # Blue eyes, see http://snpedia.com/index.php/Gs237/criteria
+ *   gs237: rs4778241 CC & rs12913832 GG & rs7495174 AA & rs8028689 TT
+ *          & rs7183877 CC & rs1800401 ~CC
+ *   sprinter: rs1815739 CC/CT
+ *
+ * A rule is a name followed by a colon and predicates joined with & (and)
+ * and | (or), where & binds tighter. Lines that don't start with a name
+ * continue the previous rule, and # starts a comment.
+ *
+ * A predicate is an RSID and one or more genotypes separated by slashes.
+ * The order of the nucleotides doesn't matter, so AG also matches GA. A
+ * tilde matches the complement, so ~CC matches GG. A single nucleotide
+ * matches a haploid call, and -- matches a no-call or a missing SNP.
+ *
+ * Each RSID is looked up only once per genome, however many predicates
+ * use it, and the predicates are then checked as bit tests on the
+ * genotype codes.
+ */
+struct DLL_PUBLIC RuleSet {
+  static const size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  RuleSet();
+  RuleSet(const RuleSet&);
+  RuleSet& operator=(const RuleSet&);
+  ~RuleSet();
+
+  /*!
+   * Compiles rules in the format above. Throws std::invalid_argument with
+   * the line number on syntax errors.
+   */
+  explicit RuleSet(const std::string& text);
+
+  /*!
+   * Adds the rules in the given text. A rule may not be given twice.
+   */
+  void add(const std::string& text);
+
+  /*!
+   * Adds the rules in the given file.
+   */
+  void load(const std::string& filename);
+
+  /*!
+   * Number of rules.
+   */
+  size_t size() const;
+
+  /*!
+   * Name of a rule.
+   */
+  const std::string& name(const size_t rule) const;
+
+  /*!
+   * Index of the rule with the given name, or NOT_FOUND.
+   */
+  size_t find(const std::string& name) const;
+
+  /*!
+   * The distinct RSIDs used by the rules, in sorted order.
+   */
+  std::vector<RSID> rsids() const;
+
+  /*!
+   * Evaluates all rules against the genome. Element n is one if rule n
+   * holds, and zero otherwise.
+   */
+  std::vector<std::uint8_t> evaluate(const Genome& genome) const;
+
+  /*!
+   * Evaluates all rules against each genome, split over the given number
+   * of threads. Zero threads means one per hardware thread. The results
+   * come one genome after the other, with size() elements each.
+   */
+  std::vector<std::uint8_t> evaluate(
+      const std::vector<const Genome*>& genomes,
+      const unsigned threads = 1) const;
+
+  /*!
+   * Like the above, for each sample of a cohort. The RSIDs are looked up
+   * in the marker dictionary only once.
+   */
+  std::vector<std::uint8_t> evaluate(const Cohort& cohort,
+                                     const unsigned threads = 1) const;
+
+private:
+  struct DLL_LOCAL RuleSetImpl;
+  RuleSetImpl* pimpl;
+};
+
+/*!
+ * A polygenic score model: a weight per variant, given for a number of
+ * copies of its effect allele. A weights file has one variant per line,
+ * as whitespace separated columns:
+ *
+ *   # rsid  effect  weight   other
+ *   rs4680  A       0.0421   G
+ *   rs53576 G       -0.0113
+ *
+ * The other allele is optional. When it's given, genotypes on the opposite
+ * strand are recognized by their complemented alleles, and calls with
+ * alleles that belong to neither are left out. Variants where the other
+ * allele is the complement of the effect allele can't be told apart, and
+ * are taken to be on the same strand. Without an other allele, only the
+ * effect allele is counted, as it is.
+ *
+ * Each variant is compiled into masks of the genotype codes that have one
+ * and two copies of the effect allele, so that a score is a lookup per
+ * variant followed by a multiply-add over contiguous arrays.
+ */
+struct DLL_PUBLIC PolygenicScore {
+  PolygenicScore();
+  PolygenicScore(const PolygenicScore&);
+  PolygenicScore& operator=(const PolygenicScore&);
+  ~PolygenicScore();
+
+  /*!
+   * Adds the variants in a weights file. A first line that doesn't start
+   * with an RSID is taken to be a header. Throws std::invalid_argument with
+   * the line number on malformed lines. Returns the number of variants that
+   * were skipped because an allele wasn't a single nucleotide.
+   */
+  size_t load(const std::string& filename);
+
+  /*!
+   * Adds a variant.
+   */
+  void add(const RSID& rsid, const Nucleotide effect, const double weight,
+           const Nucleotide other = NONE);
+
+  /*!
+   * Number of variants.
+   */
+  size_t size() const;
+
+  /*!
+   * RSIDs of the variants, in the order they were added.
+   */
+  std::vector<RSID> rsids() const;
+
+  /*!
+   * Scores a genome.
+   */
+  ScoreSum score(const Genome& genome) const;
+
+  /*!
+   * Scores each genome, split over the given number of threads. Zero
+   * threads means one per hardware thread.
+   */
+  std::vector<ScoreSum> score(const std::vector<const Genome*>& genomes,
+                              const unsigned threads = 1) const;
+
+private:
+  friend struct Cohort;
+  struct DLL_LOCAL ScoreImpl;
+  ScoreImpl* pimpl;
+};
 
 std::ostream& operator<<(std::ostream&, const Chromosome&);
 std::ostream& operator<<(std::ostream&, const Genotype&);
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+
+#include "bloom.hpp"
+
+/*
+ * Bits per RSID. Each RSID sets 8 of them.
+ */
+static const size_t BITS_PER_ID = 16;
+
+const unsigned BloomFilter::WORDS;
+
+// Odd constants, one per word, as used by split block Bloom filters
+const std::uint32_t BloomFilter::SALT[BloomFilter::WORDS] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+BloomFilter::BloomFilter() :
+  words(),
+  blocks(0),
+  capacity_(0)
+{
+}
+
+// The blocks may be aligned differently in the copy
+BloomFilter::BloomFilter(const BloomFilter& o) :
+  words(o.words.size(), 0),
+  blocks(o.blocks),
+  capacity_(o.capacity_)
+{
+  if ( blocks > 0 )
+    std::copy(o.base(), o.base() + blocks*WORDS, base());
+}
+
+BloomFilter& BloomFilter::operator=(const BloomFilter& o)
+{
+  if ( this != &o ) {
+    BloomFilter copy(o);
+    words.swap(copy.words);
+    blocks = copy.blocks;
+    capacity_ = copy.capacity_;
+  }
+  return *this;
+}
+
+void BloomFilter::reset(const size_t capacity)
+{
+  const size_t bits = std::max(capacity, static_cast<size_t>(1)) * BITS_PER_ID;
+  blocks = (bits + 64*WORDS - 1) / (64*WORDS);
+  capacity_ = capacity;
+  words.assign((blocks + 1) * WORDS, 0);
+}
+
+void BloomFilter::clear()
+{
+  std::vector<std::uint64_t>().swap(words);
+  blocks = 0;
+  capacity_ = 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_BLOOM_H
+#define DNA_BLOOM_H
+
+#include <cstdint>
+#include <vector>
+
+#include "dnatraits.hpp"
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * A Bloom filter over RSIDs, blocked by cache line. Each RSID hashes to one
+ * 512-bit block and sets a single bit in each of its eight words, so a test
+ * touches one cache line only. With 16 bits per RSID, about one in a
+ * thousand absent RSIDs gets through.
+ *
+ * An empty filter, which has never been sized, lets everything through.
+ */
+class DLL_LOCAL BloomFilter {
+public:
+  BloomFilter();
+  BloomFilter(const BloomFilter&);
+  BloomFilter& operator=(const BloomFilter&);
+
+  /*
+   * Clears the filter and sizes it for the given number of RSIDs.
+   */
+  void reset(const size_t capacity);
+
+  /*
+   * Drops the filter altogether.
+   */
+  void clear();
+
+  inline bool empty() const {
+    return blocks == 0;
+  }
+
+  inline size_t capacity() const {
+    return capacity_;
+  }
+
+  inline void add(const RSID& id) {
+    const std::uint64_t h = hash(id);
+    std::uint64_t* b = block(h);
+
+    for ( unsigned n = 0; n < WORDS; ++n )
+      b[n] |= bit(h, n);
+  }
+
+  /*
+   * Returns false if the RSID definitely hasn't been added.
+   */
+  inline bool may_contain(const RSID& id) const {
+    if ( empty() )
+      return true;
+
+    const std::uint64_t h = hash(id);
+    const std::uint64_t* b = block(h);
+    std::uint64_t missing = 0;
+
+    for ( unsigned n = 0; n < WORDS; ++n )
+      missing |= bit(h, n) & ~b[n];
+
+    return missing == 0;
+  }
+
+  /*
+   * Starts loading the block of the RSID into cache, ahead of a call to
+   * may_contain().
+   */
+  inline void prefetch(const RSID& id) const {
+    if ( !empty() )
+      __builtin_prefetch(block(hash(id)));
+  }
+
+private:
+  static const unsigned WORDS = 8; // per 64-byte block
+  static const std::uint32_t SALT[WORDS];
+
+  std::vector<std::uint64_t> words;
+  size_t blocks;
+  size_t capacity_;
+
+  static inline std::uint64_t hash(const RSID& id) {
+    // The finalizer from MurmurHash3
+    std::uint64_t h = id;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static inline std::uint64_t bit(const std::uint64_t h, const unsigned n) {
+    const std::uint32_t x = static_cast<std::uint32_t>(h) * SALT[n];
+    return static_cast<std::uint64_t>(1) << (x >> 26);
+  }
+
+  /*
+   * The words are over-allocated by one block, so the blocks can start on a
+   * cache line wherever the vector ends up.
+   */
+  inline std::uint64_t* base() const {
+    const std::uintptr_t p = reinterpret_cast<std::uintptr_t>(words.data());
+    const std::uintptr_t skip = ((64 - (p & 63)) & 63) / 8;
+    return const_cast<std::uint64_t*>(words.data()) + skip;
+  }
+
+  inline std::uint64_t* block(const std::uint64_t h) const {
+    // Maps the upper half of the hash onto [0, blocks) without a division
+    const std::uint64_t index = ((h >> 32) * blocks) >> 32;
+    return base() + index*WORDS;
+  }
+};
+
+#endif
@@ -0,0 +1,602 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <google/dense_hash_map>
+
+#include "dnatraits.hpp"
+#include "ibs.hpp"
+#include "parallel.hpp"
+#include "score.hpp"
+
+const size_t Cohort::NOT_FOUND;
+
+/*
+ * Genotype codes, two bits per sample and marker.
+ */
+enum {
+  CODE_NO_CALL = 0,
+  CODE_FIRST = 1,   // homozygous for the first allele, or haploid
+  CODE_BOTH = 2,    // heterozygous, in either order
+  CODE_SECOND = 3,  // homozygous for the second allele, or haploid
+  CODE_EXTRA = 4    // doesn't fit, so it's kept on the side
+};
+
+static const size_t CODES_PER_WORD = 32;
+
+/*
+ * What a marker's codes stand for. The alleles and ploidy are set by the
+ * first calls seen, and never change after that, so existing codes stay
+ * valid as samples are added.
+ */
+struct DLL_LOCAL Marker {
+  std::uint8_t chromosome;
+  std::uint8_t alleles[2];
+  std::uint8_t ploidy; // zero until the first call
+};
+
+struct DLL_LOCAL Sample {
+  std::vector<std::uint64_t> codes;
+
+  // Genotypes that didn't fit in two bits, sorted by marker
+  std::vector<std::pair<std::uint32_t, Genotype> > extra;
+
+  // Heterozygotes called as second allele first, sorted by marker
+  std::vector<std::uint32_t> reversed;
+
+  unsigned code(const size_t marker) const {
+    const size_t word = marker / CODES_PER_WORD;
+    if ( word >= codes.size() )
+      return CODE_NO_CALL;
+    return (codes[word] >> (2*(marker % CODES_PER_WORD))) & 3;
+  }
+
+  const Genotype* find_extra(const size_t marker) const {
+    auto it = std::lower_bound(extra.begin(), extra.end(), marker,
+        [](const std::pair<std::uint32_t, Genotype>& e, const size_t m) {
+          return e.first < m;
+        });
+    return (it != extra.end() && it->first == marker)? &it->second : NULL;
+  }
+
+  bool is_reversed(const size_t marker) const {
+    return std::binary_search(reversed.begin(), reversed.end(), marker);
+  }
+};
+
+typedef google::dense_hash_map<RSID, std::uint32_t, std::hash<RSID> >
+  MarkerMap;
+
+/*
+ * Returns the slot of the allele in the marker, taking a free one if it's
+ * new, or -1 if both are taken by others.
+ */
+static int slot(Marker& m, const Nucleotide n)
+{
+  for ( int i = 0; i < 2; ++i ) {
+    if ( m.alleles[i] == n )
+      return i;
+    if ( m.alleles[i] == NONE ) {
+      m.alleles[i] = static_cast<std::uint8_t>(n);
+      return i;
+    }
+  }
+  return -1;
+}
+
+/*
+ * Returns the code of the genotype, and sets reversed if it's a
+ * heterozygote called with the marker's second allele first.
+ */
+static unsigned encode(Marker& m, const Genotype& g, bool& reversed)
+{
+  reversed = false;
+
+  if ( g.first == NONE )
+    return g.second == NONE? CODE_NO_CALL : CODE_EXTRA;
+
+  const std::uint8_t ploidy = g.second == NONE? 1 : 2;
+
+  if ( m.ploidy == 0 )
+    m.ploidy = ploidy;
+  else if ( m.ploidy != ploidy )
+    return CODE_EXTRA;
+
+  const int a = slot(m, g.first);
+  const int b = ploidy == 1? a : slot(m, g.second);
+
+  if ( a < 0 || b < 0 )
+    return CODE_EXTRA;
+
+  if ( a == b )
+    return a == 0? CODE_FIRST : CODE_SECOND;
+
+  reversed = a == 1;
+  return CODE_BOTH;
+}
+
+static Genotype decode(const Marker& m, const unsigned code)
+{
+  const Nucleotide first = static_cast<Nucleotide>(m.alleles[0]);
+  const Nucleotide second = static_cast<Nucleotide>(m.alleles[1]);
+
+  switch ( code ) {
+  case CODE_FIRST:
+    return Genotype(first, m.ploidy == 1? NONE : first);
+  case CODE_BOTH:
+    return Genotype(first, second);
+  case CODE_SECOND:
+    return Genotype(second, m.ploidy == 1? NONE : second);
+  default:
+    return Genotype(NONE, NONE);
+  }
+}
+
+struct DLL_LOCAL Cohort::CohortImpl {
+  std::vector<RSID> rsids;
+  std::vector<Position> positions;
+  std::vector<Marker> markers;
+  MarkerMap index;
+  std::vector<Sample> samples;
+
+  CohortImpl() :
+    rsids(),
+    positions(),
+    markers(),
+    index(),
+    samples()
+  {
+    index.set_empty_key(0);
+  }
+
+  size_t marker(const RSID& rsid, const SNP& snp) {
+    auto it = index.find(rsid);
+    if ( it != index.end() )
+      return it->second;
+
+    const std::uint32_t n = static_cast<std::uint32_t>(rsids.size());
+    Marker m;
+    m.chromosome = static_cast<std::uint8_t>(snp.chromosome);
+    m.alleles[0] = m.alleles[1] = NONE;
+    m.ploidy = 0;
+
+    rsids.push_back(rsid);
+    positions.push_back(snp.position);
+    markers.push_back(m);
+    index.insert({rsid, n});
+    return n;
+  }
+
+  size_t add(const Genome& genome) {
+    Sample s;
+    s.codes.reserve((rsids.size() + genome.size()) / CODES_PER_WORD + 1);
+
+    for ( const auto& p : genome ) {
+      const size_t m = marker(p.rsid, p.snp);
+      bool reversed;
+      const unsigned code = encode(markers[m], p.snp.genotype, reversed);
+
+      if ( code == CODE_NO_CALL )
+        continue;
+
+      if ( code == CODE_EXTRA ) {
+        s.extra.push_back(std::make_pair(static_cast<std::uint32_t>(m),
+                                         p.snp.genotype));
+        continue;
+      }
+
+      if ( reversed )
+        s.reversed.push_back(static_cast<std::uint32_t>(m));
+
+      const size_t word = m / CODES_PER_WORD;
+      if ( word >= s.codes.size() )
+        s.codes.resize(word + 1, 0);
+
+      s.codes[word] |= static_cast<std::uint64_t>(code)
+                         << (2*(m % CODES_PER_WORD));
+    }
+
+    std::sort(s.extra.begin(), s.extra.end(),
+        [](const std::pair<std::uint32_t, Genotype>& a,
+           const std::pair<std::uint32_t, Genotype>& b) {
+          return a.first < b.first;
+        });
+
+    std::sort(s.reversed.begin(), s.reversed.end());
+
+    s.codes.shrink_to_fit();
+    s.extra.shrink_to_fit();
+    s.reversed.shrink_to_fit();
+    samples.push_back(std::move(s));
+    return samples.size() - 1;
+  }
+
+  Genotype genotype(const size_t sample, const size_t marker) const {
+    const Sample& s = samples.at(sample);
+    const unsigned code = s.code(marker);
+
+    if ( code != CODE_NO_CALL ) {
+      const Genotype g = decode(markers[marker], code);
+      return s.is_reversed(marker)? Genotype(g.second, g.first) : g;
+    }
+
+    auto extra = s.find_extra(marker);
+    return extra? *extra : Genotype(NONE, NONE);
+  }
+};
+
+Cohort::Cohort() :
+  pimpl(new CohortImpl())
+{
+}
+
+Cohort::Cohort(const Cohort& c) :
+  pimpl(new CohortImpl(c.impl()))
+{
+}
+
+Cohort& Cohort::operator=(const Cohort& c)
+{
+  if ( this != &c ) {
+    if ( pimpl )
+      *pimpl = c.impl();
+    else
+      pimpl = new CohortImpl(c.impl());
+  }
+  return *this;
+}
+
+static_assert(std::is_nothrow_move_constructible<Cohort>::value &&
+              std::is_nothrow_move_assignable<Cohort>::value,
+              "Cohort moves must not throw");
+
+Cohort::Cohort(Cohort&& c) noexcept :
+  pimpl(c.pimpl)
+{
+  c.pimpl = NULL;
+}
+
+Cohort& Cohort::operator=(Cohort&& c) noexcept
+{
+  if ( this != &c ) {
+    delete pimpl;
+    pimpl = c.pimpl;
+    c.pimpl = NULL;
+  }
+  return *this;
+}
+
+/*
+ * Moved-from cohorts have no implementation, just like moved-from genomes.
+ */
+Cohort::CohortImpl& Cohort::impl()
+{
+  if ( !pimpl )
+    pimpl = new CohortImpl();
+  return *pimpl;
+}
+
+const Cohort::CohortImpl& Cohort::impl() const
+{
+  static const CohortImpl empty;
+  return pimpl? *pimpl : empty;
+}
+
+Cohort::~Cohort()
+{
+  delete pimpl;
+}
+
+size_t Cohort::add(const Genome& genome)
+{
+  return impl().add(genome);
+}
+
+void Cohort::add_files(const std::vector<std::string>& filenames,
+    unsigned threads, const ParseOptions& options)
+{
+  if ( threads == 0 )
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for ( size_t n = 0; n < std::min<size_t>(threads, filenames.size()); ++n )
+    prefetch_file(filenames[n]);
+
+  for ( size_t at = 0; at < filenames.size(); at += threads ) {
+    const size_t count = std::min<size_t>(threads, filenames.size() - at);
+
+    // Get the next batch into the page cache while this one is parsed
+    for ( size_t n = at + count;
+          n < std::min(at + 2*count, filenames.size()); ++n )
+      prefetch_file(filenames[n]);
+
+    std::vector<Genome> genomes(count);
+    std::vector<std::exception_ptr> errors(count);
+    std::vector<std::thread> workers;
+
+    for ( size_t n = 1; n < count; ++n )
+      workers.push_back(std::thread([&, n]() {
+        try {
+          parse_file(filenames[at + n], genomes[n], options);
+        } catch ( ... ) {
+          errors[n] = std::current_exception();
+        }
+      }));
+
+    try {
+      parse_file(filenames[at], genomes[0], options);
+    } catch ( ... ) {
+      errors[0] = std::current_exception();
+    }
+
+    for ( auto& worker : workers )
+      worker.join();
+
+    for ( size_t n = 0; n < count; ++n ) {
+      if ( errors[n] )
+        std::rethrow_exception(errors[n]);
+      impl().add(genomes[n]);
+    }
+  }
+}
+
+size_t Cohort::size() const
+{
+  return impl().samples.size();
+}
+
+size_t Cohort::markers() const
+{
+  return impl().rsids.size();
+}
+
+size_t Cohort::marker(const RSID& rsid) const
+{
+  auto it = impl().index.find(rsid);
+  return it != impl().index.end()? it->second : NOT_FOUND;
+}
+
+RSID Cohort::rsid(const size_t marker) const
+{
+  return impl().rsids.at(marker);
+}
+
+Chromosome Cohort::chromosome(const size_t marker) const
+{
+  return static_cast<Chromosome>(impl().markers.at(marker).chromosome);
+}
+
+Position Cohort::position(const size_t marker) const
+{
+  return impl().positions.at(marker);
+}
+
+Genotype Cohort::genotype(const size_t sample, const size_t marker) const
+{
+  return impl().genotype(sample, marker);
+}
+
+CohortSample Cohort::operator[](const size_t sample) const
+{
+  return CohortSample(*this, sample);
+}
+
+/*
+ * Runs the pairwise kernel over all samples and the diploid markers.
+ */
+static void pairwise(const std::vector<Sample>& samples,
+    const std::vector<Marker>& markers, const unsigned threads,
+    const IBSSink& sink)
+{
+  std::vector<std::uint64_t> mask((markers.size() + 63) / 64, 0);
+  for ( size_t m = 0; m < markers.size(); ++m )
+    if ( markers[m].ploidy == 2 )
+      mask[m / 64] |= static_cast<std::uint64_t>(1) << (m % 64);
+
+  std::vector<CodeRow> rows(samples.size());
+  for ( size_t n = 0; n < samples.size(); ++n ) {
+    rows[n].words = samples[n].codes.data();
+    rows[n].size = samples[n].codes.size();
+  }
+
+  pairwise_ibs(rows, mask, threads, sink);
+}
+
+std::vector<IBSCounts> Cohort::ibs(const unsigned threads) const
+{
+  const CohortImpl& c = impl();
+  const size_t n = c.samples.size();
+  std::vector<IBSCounts> r(n*n);
+
+  pairwise(c.samples, c.markers, threads,
+      [&](size_t i, size_t j, size_t rows, size_t cols, const IBSCounts* t) {
+        for ( size_t a = 0; a < rows; ++a )
+          for ( size_t b = (i == j)? a + 1 : 0; b < cols; ++b ) {
+            r[(i + a)*n + j + b] = t[a*cols + b];
+            r[(j + b)*n + i + a] = t[a*cols + b];
+          }
+      });
+
+  // A sample shares both alleles with itself wherever it's called
+  for ( size_t s = 0; s < n; ++s ) {
+    IBSCounts& self = r[s*n + s];
+    self.ibs0 = self.ibs1 = self.ibs2 = 0;
+
+    for ( size_t m = 0; m < c.markers.size(); ++m )
+      self.ibs2 += c.markers[m].ploidy == 2 &&
+                   c.samples[s].code(m) != CODE_NO_CALL;
+  }
+
+  return r;
+}
+
+void Cohort::ibs(
+    const std::function<void(size_t, size_t, const IBSCounts&)>& f,
+    const unsigned threads) const
+{
+  pairwise(impl().samples, impl().markers, threads,
+      [&](size_t i, size_t j, size_t rows, size_t cols, const IBSCounts* t) {
+        for ( size_t a = 0; a < rows; ++a )
+          for ( size_t b = (i == j)? a + 1 : 0; b < cols; ++b )
+            f(i + a, j + b, t[a*cols + b]);
+      });
+}
+
+std::vector<ScoreSum> Cohort::score(const PolygenicScore& model,
+    const unsigned threads) const
+{
+  const CohortImpl& c = impl();
+  const PolygenicScore::ScoreImpl& m = *model.pimpl;
+
+  // The variants in the cohort, ordered by marker
+  std::vector<std::pair<std::uint32_t, std::uint32_t> > variants;
+  for ( size_t v = 0; v < m.rsids.size(); ++v ) {
+    auto it = c.index.find(m.rsids[v]);
+    if ( it != c.index.end() )
+      variants.push_back(std::make_pair(it->second,
+                                        static_cast<std::uint32_t>(v)));
+  }
+  std::sort(variants.begin(), variants.end());
+
+  // The weighted dosage of each of the four codes, and whether it counts
+  std::vector<std::uint32_t> markers(variants.size());
+  std::vector<double> weighted(4*variants.size());
+  std::vector<std::uint8_t> counted(4*variants.size());
+
+  for ( size_t n = 0; n < variants.size(); ++n ) {
+    const std::uint32_t v = variants[n].second;
+    markers[n] = variants[n].first;
+
+    for ( unsigned code = 0; code < 4; ++code ) {
+      const Genotype g = decode(c.markers[markers[n]], code);
+      const unsigned d = m.dosage(v, PackedSNP::code(g));
+      counted[4*n + code] = d != NO_DOSAGE;
+      weighted[4*n + code] = d != NO_DOSAGE? m.weights[v]*d : 0.0;
+    }
+  }
+
+  std::vector<ScoreSum> out(c.samples.size());
+
+  parallel_for(c.samples.size(), threads, [&](size_t begin, size_t end) {
+    for ( size_t s = begin; s < end; ++s ) {
+      const Sample& sample = c.samples[s];
+      double sum = 0;
+      std::uint32_t count = 0;
+
+      for ( size_t n = 0; n < markers.size(); ++n ) {
+        const unsigned code = sample.code(markers[n]);
+        sum += weighted[4*n + code];
+        count += counted[4*n + code];
+      }
+
+      // Genotypes that don't fit have code zero, which doesn't count
+      for ( const auto& e : sample.extra ) {
+        auto at = std::lower_bound(markers.begin(), markers.end(), e.first);
+        for ( ; at != markers.end() && *at == e.first; ++at ) {
+          const std::uint32_t v = variants[at - markers.begin()].second;
+          const unsigned d = m.dosage(v, PackedSNP::code(e.second));
+          sum += d != NO_DOSAGE? m.weights[v]*d : 0.0;
+          count += d != NO_DOSAGE;
+        }
+      }
+
+      out[s].sum = sum;
+      out[s].variants = count;
+    }
+  });
+
+  return out;
+}
+
+size_t Cohort::memory() const
+{
+  const CohortImpl& c = impl();
+
+  size_t bytes = sizeof(CohortImpl) +
+    c.rsids.capacity()*sizeof(RSID) +
+    c.positions.capacity()*sizeof(Position) +
+    c.markers.capacity()*sizeof(Marker) +
+    c.index.bucket_count()*sizeof(MarkerMap::value_type) +
+    c.samples.capacity()*sizeof(Sample);
+
+  for ( const auto& s : c.samples )
+    bytes += s.codes.capacity()*sizeof(std::uint64_t) +
+             s.extra.capacity()*sizeof(std::pair<std::uint32_t, Genotype>) +
+             s.reversed.capacity()*sizeof(std::uint32_t);
+
+  return bytes;
+}
+
+CohortSample::CohortSample(const Cohort& cohort_, const size_t index_) :
+  cohort(&cohort_),
+  index(index_)
+{
+}
+
+SNP CohortSample::operator[](const RSID& rsid) const
+{
+  const size_t m = cohort->marker(rsid);
+
+  if ( m == Cohort::NOT_FOUND )
+    return NONE_SNP;
+
+  return SNP(cohort->chromosome(m), cohort->position(m),
+             cohort->genotype(index, m));
+}
+
+bool CohortSample::has(const RSID& rsid) const
+{
+  const size_t m = cohort->marker(rsid);
+  return m != Cohort::NOT_FOUND && !(cohort->genotype(index, m) == NN);
+}
+
+size_t CohortSample::size() const
+{
+  size_t count = 0;
+
+  for ( size_t m = 0; m < cohort->markers(); ++m )
+    count += !(cohort->genotype(index, m) == NN);
+
+  return count;
+}
+
+std::vector<RSID> CohortSample::rsids() const
+{
+  std::vector<RSID> r;
+
+  for ( size_t m = 0; m < cohort->markers(); ++m )
+    if ( !(cohort->genotype(index, m) == NN) )
+      r.push_back(cohort->rsid(m));
+
+  std::sort(r.begin(), r.end());
+  return r;
+}
+
+Genome CohortSample::genome(const Storage storage) const
+{
+  Genome g(storage == STORAGE_HASH? size() : 0, storage);
+
+  for ( size_t m = 0; m < cohort->markers(); ++m ) {
+    const Genotype gt = cohort->genotype(index, m);
+    if ( gt == NN )
+      continue;
+
+    const RSID rsid = cohort->rsid(m);
+    const SNP snp(cohort->chromosome(m), cohort->position(m), gt);
+    g.insert(rsid, snp);
+
+    if ( rsid < g.first ) g.first = rsid;
+    if ( rsid > g.last ) g.last = rsid;
+    g.y_chromosome |= (snp.chromosome == CHR_Y && gt.first != NONE);
+  }
+
+  g.compact();
+  g.build_filter();
+  return g;
+}
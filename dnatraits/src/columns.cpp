@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "dnatraits.hpp"
+
+/*
+ * Sets bit i in the bitmap for each data[i] in the set, which is a bitmask
+ * over the values below 32. The bitmap must be zeroed, with room for n bits
+ * rounded up to whole words.
+ *
+ * The vector versions look up each byte in two 16-entry tables with a byte
+ * shuffle, one for values below 16 and one for the rest, and turn the
+ * results into bits with a movemask.
+ */
+static void match(const std::uint8_t* data, const size_t n,
+    const std::uint32_t set, std::uint64_t* bitmap)
+{
+  size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+  alignas(16) std::uint8_t low[16], high[16];
+  for ( unsigned k = 0; k < 16; ++k ) {
+    low[k] = (set >> k) & 1? 0xff : 0;
+    high[k] = (set >> (k + 16)) & 1? 0xff : 0;
+  }
+#endif
+
+#if defined(__AVX2__)
+  const __m256i lo = _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(low)));
+  const __m256i hi = _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(high)));
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i bit4 = _mm256_set1_epi8(0x10);
+  const __m256i above = _mm256_set1_epi8(static_cast<char>(0xe0));
+  const __m256i zero = _mm256_setzero_si256();
+
+  for ( ; i + 64 <= n; i += 64 ) {
+    std::uint64_t word = 0;
+
+    for ( unsigned half = 0; half < 2; ++half ) {
+      const __m256i v = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(data + i + 32*half));
+      const __m256i index = _mm256_and_si256(v, nibble);
+      const __m256i upper = _mm256_cmpeq_epi8(_mm256_and_si256(v, bit4), bit4);
+      const __m256i valid = _mm256_cmpeq_epi8(_mm256_and_si256(v, above), zero);
+
+      const __m256i r = _mm256_and_si256(valid, _mm256_or_si256(
+            _mm256_andnot_si256(upper, _mm256_shuffle_epi8(lo, index)),
+            _mm256_and_si256(upper, _mm256_shuffle_epi8(hi, index))));
+
+      word |= static_cast<std::uint64_t>(
+          static_cast<std::uint32_t>(_mm256_movemask_epi8(r))) << (32*half);
+    }
+
+    bitmap[i / 64] = word;
+  }
+#elif defined(__SSSE3__)
+  const __m128i lo = _mm_load_si128(reinterpret_cast<const __m128i*>(low));
+  const __m128i hi = _mm_load_si128(reinterpret_cast<const __m128i*>(high));
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i bit4 = _mm_set1_epi8(0x10);
+  const __m128i above = _mm_set1_epi8(static_cast<char>(0xe0));
+  const __m128i zero = _mm_setzero_si128();
+
+  for ( ; i + 64 <= n; i += 64 ) {
+    std::uint64_t word = 0;
+
+    for ( unsigned part = 0; part < 4; ++part ) {
+      const __m128i v = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(data + i + 16*part));
+      const __m128i index = _mm_and_si128(v, nibble);
+      const __m128i upper = _mm_cmpeq_epi8(_mm_and_si128(v, bit4), bit4);
+      const __m128i valid = _mm_cmpeq_epi8(_mm_and_si128(v, above), zero);
+
+      const __m128i r = _mm_and_si128(valid, _mm_or_si128(
+            _mm_andnot_si128(upper, _mm_shuffle_epi8(lo, index)),
+            _mm_and_si128(upper, _mm_shuffle_epi8(hi, index))));
+
+      word |= static_cast<std::uint64_t>(
+          static_cast<std::uint16_t>(_mm_movemask_epi8(r))) << (16*part);
+    }
+
+    bitmap[i / 64] = word;
+  }
+#endif
+
+  for ( ; i < n; ++i )
+    if ( data[i] < 32 && ((set >> data[i]) & 1) )
+      bitmap[i / 64] |= static_cast<std::uint64_t>(1) << (i % 64);
+}
+
+static size_t count(const std::vector<std::uint8_t>& column,
+    const std::uint32_t set)
+{
+  std::vector<std::uint64_t> bitmap((column.size() + 63) / 64, 0);
+  match(column.data(), column.size(), set, bitmap.data());
+
+  size_t r = 0;
+  for ( const auto word : bitmap )
+    r += __builtin_popcountll(word);
+
+  return r;
+}
+
+static std::vector<RSID> select(const std::vector<std::uint8_t>& column,
+    const std::uint32_t set, const std::vector<RSID>& rsids)
+{
+  std::vector<std::uint64_t> bitmap((column.size() + 63) / 64, 0);
+  match(column.data(), column.size(), set, bitmap.data());
+
+  std::vector<RSID> r;
+
+  for ( size_t n = 0; n < bitmap.size(); ++n )
+    for ( std::uint64_t word = bitmap[n]; word != 0; word &= word - 1 )
+      r.push_back(rsids[n*64 + __builtin_ctzll(word)]);
+
+  return r;
+}
+
+/*
+ * The codes of genotypes for which f is true.
+ */
+template<class F>
+static std::uint32_t codes_where(F f)
+{
+  std::uint32_t set = 0;
+
+  for ( unsigned code = 1; code < 32; ++code ) {
+    PackedSNP p;
+    p.bits = code;
+
+    // Unused codes unpack to a no-call with another code
+    const Genotype g = p.genotype();
+    if ( PackedSNP::code(g) == code && f(g) )
+      set |= static_cast<std::uint32_t>(1) << code;
+  }
+
+  return set;
+}
+
+size_t GenomeColumns::size() const
+{
+  return rsids.size();
+}
+
+SNP GenomeColumns::snp(const size_t index) const
+{
+  PackedSNP p;
+  p.bits = genotypes[index];
+  return SNP(static_cast<Chromosome>(chromosomes[index]), positions[index],
+             p.genotype());
+}
+
+size_t GenomeColumns::count(const Chromosome chromosome) const
+{
+  return ::count(chromosomes, static_cast<std::uint32_t>(1) << chromosome);
+}
+
+std::vector<RSID> GenomeColumns::select(const Chromosome chromosome) const
+{
+  return ::select(chromosomes, static_cast<std::uint32_t>(1) << chromosome,
+                  rsids);
+}
+
+size_t GenomeColumns::count_genotypes(const std::uint32_t codes) const
+{
+  return ::count(genotypes, codes);
+}
+
+std::vector<RSID> GenomeColumns::select_genotypes(
+    const std::uint32_t codes) const
+{
+  return ::select(genotypes, codes, rsids);
+}
+
+std::uint32_t GenomeColumns::no_calls()
+{
+  return static_cast<std::uint32_t>(1) << PackedSNP::code(NN);
+}
+
+std::uint32_t GenomeColumns::homozygous()
+{
+  return codes_where([](const Genotype& g) {
+    return g.first != NONE && g.first == g.second;
+  });
+}
+
+std::uint32_t GenomeColumns::heterozygous()
+{
+  return codes_where([](const Genotype& g) {
+    return g.first != NONE && g.second != NONE && g.first != g.second;
+  });
+}
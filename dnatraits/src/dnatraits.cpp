@@ -3,10 +3,20 @@
  * Distributed under the GPL v3 or later. See COPYING.
  */
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <sstream>
+#include <type_traits>
 #include <google/dense_hash_map>
+#include <sys/mman.h>
 
+#include "bloom.hpp"
 #include "dnatraits.hpp"
+#include "intersect.hpp"
+#include "packed_ids.hpp"
+#include "snapshot.hpp"
 
 struct DLL_LOCAL RSIDHash {
   inline std::size_t operator() (const RSID& rsid) const
@@ -135,22 +145,6 @@ SNP::SNP(const Chromosome& chr,
 {
 }
 
-SNP::SNP(const SNP& snp) :
-  chromosome(snp.chromosome),
-  position(snp.position),
-  genotype(snp.genotype)
-{
-}
-
-SNP& SNP::operator=(const SNP& snp) {
-  if ( this != &snp ) {
-    genotype = snp.genotype;
-    chromosome = snp.chromosome;
-    position = snp.position;
-  }
-  return *this;
-}
-
 bool SNP::operator==(const SNP& snp) const
 {
   return genotype == snp.genotype &&
@@ -200,100 +194,654 @@ bool SNP::operator==(const Genotype& g) const
   return genotype == g;
 }
 
+/*
+ * With STORAGE_SORTED, inserted SNPs are staged in a hash map, and merged
+ * into the sorted arrays once there are this many, or half as many as are
+ * already sorted.
+ */
+static const size_t MIN_STAGED = 1 << 16;
+
+/*
+ * SNPs keyed by one kind of ID. With STORAGE_HASH, they're kept in a hash
+ * map. With STORAGE_SORTED, they're kept in packed, sorted arrays, and new
+ * ones are staged in the hash map until compacted. Either way, they may
+ * instead be in sorted arrays straight from a memory mapped snapshot, in
+ * which case the table is read-only until thawed.
+ */
+struct DLL_LOCAL SNPTable {
+  Storage storage;
+  SNPMap map;
+  PackedIDs packed;
+  std::vector<SNP> packed_snps;
+  SortedSNPs sorted;
+  bool frozen;
+
+  SNPTable(const size_t size, const Storage storage_) :
+    storage(storage_),
+    map(storage_ == STORAGE_HASH? size : 0),
+    packed(),
+    packed_snps(),
+    sorted(),
+    frozen(false)
+  {
+    map.set_empty_key(0);
+  }
+
+  /*
+   * Returns the SNP with the given ID, or NULL if there is none.
+   */
+  const SNP* find(const RSID& id) const {
+    if ( frozen )
+      return sorted.find(id);
+
+    if ( storage == STORAGE_SORTED ) {
+      const size_t n = packed.find(id);
+
+      if ( n != PackedIDs::NOT_FOUND )
+        return &packed_snps[n];
+
+      if ( map.empty() )
+        return NULL;
+    }
+
+    auto it = map.find(id);
+    return it != map.end()? &it->second : NULL;
+  }
+
+  /*
+   * The two halves of find(), for overlapping several lookups. locate()
+   * starts loading what find_located() will need, and returns a hint for
+   * it.
+   */
+  size_t locate(const RSID& id) const {
+    if ( frozen || storage != STORAGE_SORTED )
+      return PackedIDs::NOT_FOUND;
+
+    return packed.locate(id);
+  }
+
+  const SNP* find_located(const size_t hint, const RSID& id) const {
+    if ( frozen || storage != STORAGE_SORTED )
+      return find(id);
+
+    if ( hint != PackedIDs::NOT_FOUND ) {
+      const size_t n = packed.find_in(hint, id);
+
+      if ( n != PackedIDs::NOT_FOUND )
+        return &packed_snps[n];
+    }
+
+    if ( map.empty() )
+      return NULL;
+
+    auto it = map.find(id);
+    return it != map.end()? &it->second : NULL;
+  }
+
+  /*
+   * The SNPs kept in sorted order, either from a snapshot or packed. They
+   * come before those in the hash map when iterating.
+   */
+  size_t sorted_size() const {
+    return frozen? sorted.count : packed.size();
+  }
+
+  RSID sorted_id(const size_t n) const {
+    return frozen? sorted.ids[n] : packed[n];
+  }
+
+  const SNP& sorted_snp(const size_t n) const {
+    return frozen? sorted.snps[n] : packed_snps[n];
+  }
+
+  size_t size() const {
+    return sorted_size() + map.size();
+  }
+
+  /*
+   * Calls f(id, snp) for each SNP.
+   */
+  template <class F>
+  void for_each(F f) const {
+    const size_t count = sorted_size();
+
+    for ( size_t n = 0; n < count; ++n )
+      f(sorted_id(n), sorted_snp(n));
+
+    for ( const auto& i : map )
+      f(i.first, i.second);
+  }
+
+  /*
+   * Adds a SNP, unless there already is one with the same ID.
+   */
+  void insert(const RSID& id, const SNP& snp) {
+    if ( storage == STORAGE_HASH ) {
+      map.insert({id, snp});
+      return;
+    }
+
+    if ( packed.find(id) == PackedIDs::NOT_FOUND )
+      map.insert({id, snp});
+
+    if ( map.size() >= std::max(MIN_STAGED, packed.size() / 2) )
+      compact();
+  }
+
+  /*
+   * Adds count SNPs, skipping IDs that are already there. With
+   * STORAGE_SORTED, a batch that would fill the staging map is instead
+   * appended to the staged SNPs and merged in with one sort.
+   */
+  void insert_many(const RSID* ids, const SNP* snps, const size_t count) {
+    if ( storage == STORAGE_HASH ) {
+      for ( size_t n = 0; n < count; ++n )
+        map.insert({ids[n], snps[n]});
+      return;
+    }
+
+    if ( map.size() + count < std::max(MIN_STAGED, packed.size() / 2) ) {
+      for ( size_t n = 0; n < count; ++n )
+        if ( packed.find(ids[n]) == PackedIDs::NOT_FOUND )
+          map.insert({ids[n], snps[n]});
+      return;
+    }
+
+    std::vector<std::pair<RSID, SNP> > staged(map.begin(), map.end());
+    staged.reserve(staged.size() + count);
+
+    for ( size_t n = 0; n < count; ++n )
+      staged.push_back(std::make_pair(ids[n], snps[n]));
+
+    merge(staged);
+  }
+
+  void reserve(const size_t size) {
+    // Staged SNPs are merged long before a table this size would fill up
+    if ( storage == STORAGE_HASH )
+      map.resize(size);
+  }
+
+  /*
+   * Merges the staged SNPs into the packed arrays.
+   */
+  void compact() {
+    if ( storage != STORAGE_SORTED || map.empty() )
+      return;
+
+    std::vector<std::pair<RSID, SNP> > staged(map.begin(), map.end());
+    merge(staged);
+  }
+
+  /*
+   * Sorts the staged SNPs into the packed arrays. Of those with the same
+   * ID, the packed one is kept, and then the first staged one.
+   */
+  void merge(std::vector<std::pair<RSID, SNP> >& staged) {
+    std::stable_sort(staged.begin(), staged.end(),
+        [](const std::pair<RSID, SNP>& a, const std::pair<RSID, SNP>& b) {
+          return a.first < b.first;
+        });
+
+    staged.erase(std::unique(staged.begin(), staged.end(),
+        [](const std::pair<RSID, SNP>& a, const std::pair<RSID, SNP>& b) {
+          return a.first == b.first;
+        }), staged.end());
+
+    const size_t count = packed.size() + staged.size();
+    std::vector<RSID> ids;
+    std::vector<SNP> snps;
+    ids.reserve(count);
+    snps.reserve(count);
+
+    size_t i = 0;
+    for ( const auto& s : staged ) {
+      for ( ; i < packed.size() && packed[i] < s.first; ++i ) {
+        ids.push_back(packed[i]);
+        snps.push_back(packed_snps[i]);
+      }
+      if ( i < packed.size() && packed[i] == s.first )
+        continue;
+      ids.push_back(s.first);
+      snps.push_back(s.second);
+    }
+    for ( ; i < packed.size(); ++i ) {
+      ids.push_back(packed[i]);
+      snps.push_back(packed_snps[i]);
+    }
+
+    packed.assign(ids.data(), ids.size());
+    packed_snps.swap(snps);
+    clear_map();
+  }
+
+  /*
+   * Switches over to the given sorted arrays, which must outlive the table
+   * or a call to thaw().
+   */
+  void freeze(const SortedSNPs& s) {
+    clear_map();
+    packed = PackedIDs();
+    std::vector<SNP>().swap(packed_snps);
+    sorted = s;
+    frozen = true;
+  }
+
+  /*
+   * Moves the sorted arrays into the hash map or the packed arrays, so they
+   * can be modified.
+   */
+  void thaw() {
+    if ( !frozen )
+      return;
+
+    if ( storage == STORAGE_SORTED ) {
+      packed.assign(sorted.ids, sorted.count);
+      packed_snps.assign(sorted.snps, sorted.snps + sorted.count);
+    } else {
+      map.resize(sorted.count);
+
+      for ( size_t n = 0; n < sorted.count; ++n )
+        map.insert({sorted.ids[n], sorted.snps[n]});
+    }
+
+    sorted = SortedSNPs();
+    frozen = false;
+  }
+
+  /*
+   * Returns the contents sorted by ID. If they aren't already, they're
+   * sorted into the given vectors.
+   */
+  SortedSNPs sort(std::vector<RSID>& ids, std::vector<SNP>& snps) const {
+    if ( frozen )
+      return sorted;
+
+    if ( map.empty() ) {
+      ids = packed.unpack();
+      return SortedSNPs(ids.data(), packed_snps.data(), ids.size());
+    }
+
+    ids.clear();
+    ids.reserve(size());
+    for_each([&](const RSID& id, const SNP&) {
+      ids.push_back(id);
+    });
+    std::sort(ids.begin(), ids.end());
+
+    snps.resize(ids.size());
+    for ( size_t n = 0; n < ids.size(); ++n )
+      snps[n] = *find(ids[n]);
+
+    return SortedSNPs(ids.data(), snps.data(), ids.size());
+  }
+
+private:
+  void clear_map() {
+    SNPMap empty(0);
+    empty.set_empty_key(0);
+    map.swap(empty);
+  }
+};
+
+/*
+ * How many RSIDs batched lookups work on at a time.
+ */
+static const size_t LOOKAHEAD = 16;
+
+/*
+ * Walks the sorted part of a table first, and then its hash map.
+ */
 struct GenomeIteratorImpl {
+  const SNPTable* table;
+  size_t index;
   SNPMap::const_iterator it;
 
-  GenomeIteratorImpl(SNPMap::const_iterator& i):
+  GenomeIteratorImpl(const SNPTable* t, const size_t n,
+      const SNPMap::const_iterator& i):
+    table(t),
+    index(n),
     it(i)
   {
   }
+
+  static GenomeIteratorImpl begin(const SNPTable& t)
+  {
+    return GenomeIteratorImpl(&t, 0, t.map.begin());
+  }
+
+  static GenomeIteratorImpl end(const SNPTable& t)
+  {
+    return GenomeIteratorImpl(&t, t.sorted_size(), t.map.end());
+  }
+
+  bool operator==(const GenomeIteratorImpl& o) const
+  {
+    return index == o.index && it == o.it;
+  }
 };
 
-GenomeIterator::GenomeIterator(GenomeIteratorImpl* p):
-  pimpl(p)
+static_assert(sizeof(GenomeIteratorImpl) <= 48 &&
+              alignof(GenomeIteratorImpl) <= 8,
+              "GenomeIteratorImpl must fit in GenomeIterator::state");
+
+GenomeIteratorImpl& GenomeIterator::impl()
+{
+  return *reinterpret_cast<GenomeIteratorImpl*>(state);
+}
+
+const GenomeIteratorImpl& GenomeIterator::impl() const
 {
+  return *reinterpret_cast<const GenomeIteratorImpl*>(state);
+}
+
+GenomeIterator::GenomeIterator(const GenomeIteratorImpl& i):
+  current()
+{
+  new (state) GenomeIteratorImpl(i);
 }
 
 GenomeIterator::~GenomeIterator()
 {
-  delete pimpl;
+  impl().~GenomeIteratorImpl();
 }
 
 GenomeIterator::GenomeIterator(const GenomeIterator& o):
-  pimpl(new GenomeIteratorImpl(o.pimpl->it))
+  current(o.current)
 {
+  new (state) GenomeIteratorImpl(o.impl());
 }
 
 GenomeIterator& GenomeIterator::operator=(const GenomeIterator& o)
 {
-  if ( pimpl != o.pimpl ) {
-    delete pimpl;
-    pimpl = new GenomeIteratorImpl(o.pimpl->it);
-  }
+  impl() = o.impl();
+  current = o.current;
   return *this;
 }
 
 GenomeIterator& GenomeIterator::operator++()
 {
-  ++pimpl->it;
+  GenomeIteratorImpl& i = impl();
+
+  if ( i.index < i.table->sorted_size() )
+    ++i.index;
+  else
+    ++i.it;
   return *this;
 }
 
-const RsidSNP GenomeIterator::operator*()
+const RsidSNP& GenomeIterator::operator*()
 {
-  RsidSNP r;
-  r.rsid = (*pimpl->it).first;
-  r.snp = (*pimpl->it).second;
-  return r;
+  const GenomeIteratorImpl& i = impl();
+
+  if ( i.index < i.table->sorted_size() ) {
+    current.rsid = i.table->sorted_id(i.index);
+    current.snp = i.table->sorted_snp(i.index);
+  } else {
+    current.rsid = i.it->first;
+    current.snp = i.it->second;
+  }
+  return current;
 }
 
-bool GenomeIterator::operator==(const GenomeIterator& o)
+const RsidSNP* GenomeIterator::operator->()
 {
-  return pimpl->it == o.pimpl->it;
+  return &**this;
 }
 
-bool GenomeIterator::operator!=(const GenomeIterator& o)
+bool GenomeIterator::operator==(const GenomeIterator& o) const
 {
-  return pimpl->it != o.pimpl->it;
+  return impl() == o.impl();
 }
 
-struct DLL_LOCAL Genome::GenomeImpl {
-  SNPMap snps;
+bool GenomeIterator::operator!=(const GenomeIterator& o) const
+{
+  return !(impl() == o.impl());
+}
+
+/*
+ * The SNPs sorted by chromosome and position, with an offset to where each
+ * chromosome starts.
+ */
+struct DLL_LOCAL PositionIndex {
+  std::vector<RSID> rsids;
+  std::vector<SNP> snps;
+  size_t offsets[CHR_Y + 2];
+
+  PositionIndex(const SNPTable& table) :
+    rsids(),
+    snps()
+  {
+    std::vector<std::pair<std::uint64_t, RSID> > keys;
+    keys.reserve(table.size());
+
+    table.for_each([&](const RSID& id, const SNP& snp) {
+      // Genome::insert() takes any SNP, but find() only queries up to CHR_Y
+      if ( snp.chromosome > CHR_Y )
+        return;
+
+      const std::uint64_t key = static_cast<std::uint64_t>(snp.chromosome) << 32
+                              | snp.position;
+      keys.push_back(std::make_pair(key, id));
+    });
+
+    std::sort(keys.begin(), keys.end());
+
+    rsids.resize(keys.size());
+    snps.resize(keys.size());
+    std::fill(offsets, offsets + CHR_Y + 2, 0);
 
-  GenomeImpl(const size_t size) :
-    snps(size)
+    for ( size_t n = 0; n < keys.size(); ++n ) {
+      rsids[n] = keys[n].second;
+      snps[n] = *table.find(rsids[n]);
+      ++offsets[snps[n].chromosome + 1];
+    }
+
+    for ( unsigned c = 1; c < CHR_Y + 2; ++c )
+      offsets[c] += offsets[c - 1];
+  }
+
+  SNPSpan find(const Chromosome chromosome, const Position start,
+      const Position end) const
   {
-    snps.set_empty_key(0);
+    const auto less = [](const SNP& snp, const Position p) {
+      return snp.position < p;
+    };
+
+    const SNP* first = snps.data() + offsets[chromosome];
+    const SNP* last = snps.data() + offsets[chromosome + 1];
+    const SNP* from = std::lower_bound(first, last, start, less);
+    const SNP* to = std::lower_bound(from, last, end, less);
+
+    SNPSpan span;
+    span.rsids = rsids.data() + (from - snps.data());
+    span.snps = from;
+    span.size = to - from;
+    return span;
   }
+};
 
-  GenomeImpl(const GenomeImpl& g) :
-    snps(g.snps)
+/*
+ * A mutex that copies as a new one, so the struct holding it can be copied.
+ */
+struct DLL_LOCAL CopyableMutex {
+  std::mutex mutex;
+
+  CopyableMutex() : mutex()
   {
-    snps.set_empty_key(0);
   }
 
-  GenomeImpl& operator=(const GenomeImpl& g)
+  CopyableMutex(const CopyableMutex&) : mutex()
   {
-    if ( this != &g )
-      snps = g.snps;
+  }
 
+  CopyableMutex& operator=(const CopyableMutex&)
+  {
     return *this;
   }
+};
+
+struct DLL_LOCAL Genome::GenomeImpl {
+  SNPTable snps;
+
+  /*
+   * SNPs with 23andMe internal IDs, which are in a different number space
+   * than RSIDs.
+   */
+  SNPTable internal;
+
+  /*
+   * Set when the tables are backed by a memory mapped snapshot instead of
+   * hash maps. It's shared between copies, since it's read-only.
+   */
+  std::shared_ptr<const Snapshot> snapshot;
+
+  /*
+   * Lets lookups of absent RSIDs skip the table. Once built, it's kept up to
+   * date, and rebuilt whenever the genome has doubled in size.
+   */
+  BloomFilter filter;
+
+  /*
+   * Built on the first position query, and dropped on changes.
+   */
+  mutable std::shared_ptr<const PositionIndex> positions;
+  mutable CopyableMutex positions_lock;
+
+  GenomeImpl(const size_t size, const Storage storage) :
+    snps(size, storage),
+    internal(0, storage),
+    snapshot(),
+    filter(),
+    positions(),
+    positions_lock()
+  {
+  }
+
+  const PositionIndex& position_index() const {
+    std::lock_guard<std::mutex> guard(positions_lock.mutex);
+
+    if ( !positions )
+      positions.reset(new PositionIndex(snps));
+
+    return *positions;
+  }
 
-  bool contains(const RSID& rsid) const {
-    return snps.find(rsid) != snps.end();
+  const SNP* find(const RSID& rsid) const {
+    return filter.may_contain(rsid)? snps.find(rsid) : NULL;
   }
 
   const SNP& operator[](const RSID& rsid) const {
-    return !contains(rsid)? NONE_SNP : const_cast<SNPMap&>(snps)[rsid];
+    auto snp = find(rsid);
+    return snp? *snp : NONE_SNP;
+  }
+
+  /*
+   * Looks up a group of RSIDs at a time, in stages: first the filter blocks
+   * are prefetched, then the filter is checked and the packed blocks are
+   * located and prefetched, and finally the lookups are finished. Each
+   * stage waits on memory for all of the group at once, instead of one RSID
+   * at a time. The hash map can't be prefetched into, so with STORAGE_HASH
+   * only the filter stage overlaps. Snapshots have no filter, and run their
+   * binary searches in lockstep instead.
+   */
+  size_t lookup(const RSID* ids, const size_t count, SNP* out,
+      bool* found) const {
+    const size_t MISSING = static_cast<size_t>(-2);
+    size_t hints[LOOKAHEAD];
+    const SNP* located[LOOKAHEAD];
+    size_t hits = 0;
+
+    for ( size_t base = 0; base < count; base += LOOKAHEAD ) {
+      const size_t group = std::min(LOOKAHEAD, count - base);
+      const RSID* id = ids + base;
+
+      if ( snps.frozen ) {
+        snps.sorted.find(id, group, located);
+      } else {
+        for ( size_t n = 0; n < group; ++n )
+          filter.prefetch(id[n]);
+
+        for ( size_t n = 0; n < group; ++n )
+          hints[n] = filter.may_contain(id[n])? snps.locate(id[n]) : MISSING;
+
+        for ( size_t n = 0; n < group; ++n )
+          located[n] = hints[n] == MISSING? NULL :
+                       snps.find_located(hints[n], id[n]);
+      }
+
+      for ( size_t n = 0; n < group; ++n ) {
+        auto snp = located[n];
+
+        out[base + n] = snp? *snp : NONE_SNP;
+        if ( found != NULL )
+          found[base + n] = snp != NULL;
+        hits += snp != NULL;
+      }
+    }
+
+    return hits;
+  }
+
+  void insert(const RSID& rsid, const SNP& snp) {
+    snps.insert(rsid, snp);
+    positions.reset();
+
+    if ( !filter.empty() ) {
+      if ( snps.size() > 2*filter.capacity() )
+        build_filter();
+      else
+        filter.add(rsid);
+    }
+  }
+
+  void insert_many(const RSID* rsids, const SNP* batch, const size_t count) {
+    snps.insert_many(rsids, batch, count);
+    positions.reset();
+
+    if ( !filter.empty() ) {
+      if ( snps.size() > 2*filter.capacity() )
+        build_filter();
+      else
+        for ( size_t n = 0; n < count; ++n )
+          filter.add(rsids[n]);
+    }
+  }
+
+  void build_filter() {
+    filter.reset(snps.size());
+    snps.for_each([&](const RSID& id, const SNP&) {
+      filter.add(id);
+    });
+  }
+
+  void load(const std::shared_ptr<const Snapshot>& s) {
+    snapshot = s;
+    snps.freeze(s->rsids());
+    internal.freeze(s->internal());
+    filter.clear();
+    positions.reset();
+  }
+
+  /*
+   * Moves the contents of a snapshot into the hash maps, so they can be
+   * modified.
+   */
+  void thaw() {
+    if ( !snapshot )
+      return;
+
+    snps.thaw();
+    internal.thaw();
+    snapshot.reset();
   }
 };
 
-Genome::Genome(const size_t size):
+Genome::Genome(const size_t size, const Storage storage):
   y_chromosome(false),
   first(0xffffffff),
   last(0),
-  pimpl(new GenomeImpl(size))
+  pimpl(new GenomeImpl(size, storage))
 {
 }
 
@@ -301,14 +849,50 @@ Genome::Genome(const Genome& g) :
   y_chromosome(g.y_chromosome),
   first(g.first),
   last(g.last),
-  pimpl(new GenomeImpl(*g.pimpl))
+  pimpl(new GenomeImpl(g.impl()))
 {
 }
 
+static_assert(std::is_nothrow_move_constructible<Genome>::value &&
+              std::is_nothrow_move_assignable<Genome>::value,
+              "Genome moves must not throw");
+
+Genome::Genome(Genome&& g) noexcept :
+  y_chromosome(g.y_chromosome),
+  first(g.first),
+  last(g.last),
+  pimpl(g.pimpl)
+{
+  g.pimpl = NULL;
+  g.y_chromosome = false;
+  g.first = 0xffffffff;
+  g.last = 0;
+}
+
+Genome& Genome::operator=(Genome&& g) noexcept
+{
+  if ( this != &g ) {
+    delete pimpl;
+    pimpl = g.pimpl;
+    y_chromosome = g.y_chromosome;
+    first = g.first;
+    last = g.last;
+
+    g.pimpl = NULL;
+    g.y_chromosome = false;
+    g.first = 0xffffffff;
+    g.last = 0;
+  }
+  return *this;
+}
+
 Genome& Genome::operator=(const Genome& g)
 {
   if ( this != &g ) {
-    *pimpl = *g.pimpl;
+    if ( pimpl )
+      *pimpl = g.impl();
+    else
+      pimpl = new GenomeImpl(g.impl());
     y_chromosome = g.y_chromosome;
     first = g.first;
     last = g.last;
@@ -316,6 +900,23 @@ Genome& Genome::operator=(const Genome& g)
   return *this;
 }
 
+/*
+ * Moved-from genomes have no implementation. They read as the shared empty
+ * one, and get their own when first modified.
+ */
+Genome::GenomeImpl& Genome::impl()
+{
+  if ( !pimpl )
+    pimpl = new GenomeImpl(0, STORAGE_HASH);
+  return *pimpl;
+}
+
+const Genome::GenomeImpl& Genome::impl() const
+{
+  static const GenomeImpl empty(0, STORAGE_HASH);
+  return pimpl? *pimpl : empty;
+}
+
 Genome::~Genome()
 {
   delete pimpl;
@@ -323,82 +924,295 @@ Genome::~Genome()
 
 const SNP& Genome::operator[](const RSID& rsid) const
 {
-  return (*pimpl)[rsid];
+  return impl()[rsid];
+}
+
+size_t Genome::lookup(const RSID* rsids, const size_t count, SNP* out,
+    bool* found) const
+{
+  return impl().lookup(rsids, count, out, found);
 }
 
 bool Genome::has(const RSID& rsid) const
 {
-  return pimpl->contains(rsid);
+  return impl().find(rsid) != NULL;
 }
 
 size_t Genome::size() const
 {
-  return pimpl->snps.size();
+  return impl().snps.size();
 }
 
 double Genome::load_factor() const
 {
-  return pimpl->snps.load_factor();
+  // Snapshots and packed arrays are dense
+  if ( impl().snapshot || impl().snps.storage == STORAGE_SORTED )
+    return 1.0;
+
+  return impl().snps.map.load_factor();
 }
 
 void Genome::insert(const RSID& rsid, const SNP& snp)
 {
-  pimpl->snps.insert({rsid, snp});
+  impl().thaw();
+  impl().insert(rsid, snp);
 }
 
-std::vector<RSID> Genome::intersect_rsid(const Genome& genome) const
+void Genome::insert_many(const RSID* rsids, const SNP* snps,
+    const size_t count)
 {
-  std::vector<RSID> r;
+  reserve(size() + count);
+  impl().insert_many(rsids, snps, count);
+}
+
+void Genome::reserve(const size_t size)
+{
+  impl().thaw();
+  impl().snps.reserve(size);
+}
+
+void Genome::compact()
+{
+  impl().snps.compact();
+  impl().internal.compact();
+}
+
+void Genome::build_filter()
+{
+  impl().build_filter();
+}
+
+void Genome::drop_filter()
+{
+  impl().filter.clear();
+}
+
+Storage Genome::storage() const
+{
+  return impl().snps.storage;
+}
+
+const SNP& Genome::internal(const InternalID& id) const
+{
+  auto snp = impl().internal.find(id);
+  return snp? *snp : NONE_SNP;
+}
+
+bool Genome::has_internal(const InternalID& id) const
+{
+  return impl().internal.find(id) != NULL;
+}
+
+size_t Genome::internal_size() const
+{
+  return impl().internal.size();
+}
+
+void Genome::insert_internal(const InternalID& id, const SNP& snp)
+{
+  impl().thaw();
+  impl().internal.insert(id, snp);
+}
+
+/*
+ * Counts the IDs in a that are also found in b, and optionally have the same
+ * SNP, and stores them in sorted order if out isn't NULL.
+ *
+ * If both tables are fully sorted, their ID arrays are intersected
+ * directly. Otherwise, each ID in a is looked up with find.
+ */
+template<class Find>
+static size_t intersect(const SNPTable& a, const SNPTable& b, Find find,
+    const bool same_snp, const unsigned threads, std::vector<RSID>* out)
+{
+  if ( a.sorted_size() != a.size() || b.sorted_size() != b.size() ) {
+    std::vector<RSID> r;
+    size_t count = 0;
+
+    a.for_each([&](const RSID& id, const SNP& snp) {
+      auto other = find(id);
+      if ( other != NULL && (!same_snp || *other == snp) ) {
+        ++count;
+        if ( out != NULL )
+          r.push_back(id);
+      }
+    });
+
+    if ( out != NULL ) {
+      if ( a.sorted_size() != a.size() )
+        std::sort(r.begin(), r.end());
+      out->swap(r);
+    }
+
+    return count;
+  }
+
+  std::vector<RSID> aids, bids;
+  std::vector<SNP> asnps, bsnps;
+  const SortedSNPs x = a.sort(aids, asnps);
+  const SortedSNPs y = b.sort(bids, bsnps);
+
+  // Positions are only needed to compare SNPs or to return the IDs
+  std::vector<Match> m((out != NULL || same_snp)?
+      std::min(x.count, y.count) : 0);
+
+  size_t count = intersect_sorted(x.ids, x.count, y.ids, y.count,
+      m.empty()? NULL : m.data(), threads);
+
+  if ( same_snp ) {
+    size_t kept = 0;
+    for ( size_t n = 0; n < count; ++n )
+      if ( x.snps[m[n].a] == y.snps[m[n].b] )
+        m[kept++] = m[n];
+    count = kept;
+  }
+
+  if ( out != NULL ) {
+    out->resize(count);
+    for ( size_t n = 0; n < count; ++n )
+      (*out)[n] = x.ids[m[n].a];
+  }
 
-  for ( const auto i : pimpl->snps )
-    if ( genome.has(i.first) )
-      r.push_back(i.first);
+  return count;
+}
+
+static std::vector<RSID> ids(const SNPTable& t)
+{
+  std::vector<RSID> r(t.size());
+
+  size_t n = 0;
+  t.for_each([&](const RSID& id, const SNP&) {
+    r[n++] = id;
+  });
 
   return r;
 }
 
-std::vector<RSID> Genome::intersect_snp(const Genome& genome) const
+std::vector<RSID> Genome::intersect_rsid(const Genome& genome,
+    const unsigned threads) const
 {
+  const GenomeImpl& other = genome.impl();
   std::vector<RSID> r;
+  intersect(impl().snps, other.snps,
+      [&](const RSID& id) { return other.find(id); }, false, threads, &r);
+  return r;
+}
 
-  for ( const auto i : pimpl->snps )
-    if ( genome.has(i.first) )
-      if ( genome[i.first] == operator[](i.first) )
-        r.push_back(i.first);
-
+std::vector<RSID> Genome::intersect_snp(const Genome& genome,
+    const unsigned threads) const
+{
+  const GenomeImpl& other = genome.impl();
+  std::vector<RSID> r;
+  intersect(impl().snps, other.snps,
+      [&](const RSID& id) { return other.find(id); }, true, threads, &r);
   return r;
 }
 
-std::vector<RSID> Genome::rsids() const
+size_t Genome::intersect_rsid_count(const Genome& genome,
+    const unsigned threads) const
 {
-  std::vector<RSID> r(size());
+  const GenomeImpl& other = genome.impl();
+  return intersect(impl().snps, other.snps,
+      [&](const RSID& id) { return other.find(id); }, false, threads, NULL);
+}
 
-  size_t n = 0;
-  for ( const auto i : pimpl->snps )
-    r[n++] = i.first;
+size_t Genome::intersect_snp_count(const Genome& genome,
+    const unsigned threads) const
+{
+  const GenomeImpl& other = genome.impl();
+  return intersect(impl().snps, other.snps,
+      [&](const RSID& id) { return other.find(id); }, true, threads, NULL);
+}
 
+std::vector<InternalID> Genome::intersect_internal(const Genome& genome) const
+{
+  const SNPTable& other = genome.impl().internal;
+  std::vector<InternalID> r;
+  intersect(impl().internal, other,
+      [&](const InternalID& id) { return other.find(id); }, false, 1, &r);
   return r;
 }
 
+std::vector<RSID> Genome::rsids() const
+{
+  return ids(impl().snps);
+}
+
+std::vector<InternalID> Genome::internal_ids() const
+{
+  return ids(impl().internal);
+}
+
 std::vector<SNP> Genome::snps() const
 {
   std::vector<SNP> r(size());
 
   size_t n = 0;
-  for ( const auto i : pimpl->snps )
-    r[n++] = i.second;
+  impl().snps.for_each([&](const RSID&, const SNP& snp) {
+    r[n++] = snp;
+  });
 
   return r;
 }
 
+SNPSpan Genome::find(const Chromosome chromosome, const Position start,
+    const Position end) const
+{
+  if ( chromosome > CHR_Y || start >= end ) {
+    SNPSpan none = {NULL, NULL, 0};
+    return none;
+  }
+
+  return impl().position_index().find(chromosome, start, end);
+}
+
+GenomeColumns Genome::columns() const
+{
+  std::vector<RSID> ids;
+  std::vector<SNP> snps;
+  const SortedSNPs sorted = impl().snps.sort(ids, snps);
+
+  GenomeColumns c;
+  c.rsids.assign(sorted.ids, sorted.ids + sorted.count);
+  c.chromosomes.resize(sorted.count);
+  c.positions.resize(sorted.count);
+  c.genotypes.resize(sorted.count);
+
+  for ( size_t n = 0; n < sorted.count; ++n ) {
+    const SNP& snp = sorted.snps[n];
+    c.chromosomes[n] = snp.chromosome;
+    c.positions[n] = snp.position;
+    c.genotypes[n] = PackedSNP::code(snp.genotype);
+  }
+
+  return c;
+}
+
+static bool equal(const SNPTable& a, const SNPTable& b)
+{
+  if ( a.size() != b.size() )
+    return false;
+
+  bool equal = true;
+  a.for_each([&](const RSID& id, const SNP& snp) {
+    if ( equal ) {
+      auto other = b.find(id);
+      equal = other != NULL && *other == snp;
+    }
+  });
+
+  return equal;
+}
+
 bool Genome::operator==(const Genome& o) const
 {
   // cheap tests first
   if ( !(first == o.first && last == o.last && y_chromosome == o.y_chromosome
         && size() == o.size() ) )
     return false;
-  else
-    return o.pimpl->snps == pimpl->snps;
+
+  return equal(impl().snps, o.impl().snps) &&
+         equal(impl().internal, o.impl().internal);
 }
 
 bool Genome::operator!=(const Genome& o) const
@@ -408,14 +1222,67 @@ bool Genome::operator!=(const Genome& o) const
 
 GenomeIterator Genome::begin() const
 {
-  auto i = const_cast<const SNPMap&>(pimpl->snps).begin();
-  auto p = new GenomeIteratorImpl(i);
-  return GenomeIterator(p);
+  return GenomeIterator(GenomeIteratorImpl::begin(impl().snps));
 }
 
 GenomeIterator Genome::end() const
 {
-  auto i = const_cast<const SNPMap&>(pimpl->snps).end();
-  auto p = new GenomeIteratorImpl(i);
-  return GenomeIterator(p);
+  return GenomeIterator(GenomeIteratorImpl::end(impl().snps));
+}
+
+GenomeIterator Genome::internal_begin() const
+{
+  return GenomeIterator(GenomeIteratorImpl::begin(impl().internal));
+}
+
+GenomeIterator Genome::internal_end() const
+{
+  return GenomeIterator(GenomeIteratorImpl::end(impl().internal));
+}
+
+void Genome::save(const std::string& filename) const
+{
+  std::vector<RSID> ids, internal_ids;
+  std::vector<SNP> snps, internal_snps;
+
+  Snapshot::write(filename, *this,
+                  impl().snps.sort(ids, snps),
+                  impl().internal.sort(internal_ids, internal_snps));
+}
+
+void Genome::load(const std::string& filename, const bool verify)
+{
+  std::shared_ptr<const Snapshot> snapshot(new Snapshot(filename, verify));
+
+  impl().load(snapshot);
+
+  y_chromosome = snapshot->y_chromosome();
+  first = snapshot->first();
+  last = snapshot->last();
+}
+
+void Genome::publish(const std::string& name) const
+{
+  std::vector<RSID> ids, internal_ids;
+  std::vector<SNP> snps, internal_snps;
+
+  Snapshot::publish(name, *this,
+                    impl().snps.sort(ids, snps),
+                    impl().internal.sort(internal_ids, internal_snps));
+}
+
+void Genome::attach(const std::string& name, const bool verify)
+{
+  std::shared_ptr<const Snapshot> snapshot(Snapshot::attach(name, verify));
+
+  impl().load(snapshot);
+
+  y_chromosome = snapshot->y_chromosome();
+  first = snapshot->first();
+  last = snapshot->last();
+}
+
+bool Genome::unpublish(const std::string& name)
+{
+  return shm_unlink(name.c_str()) == 0;
 }
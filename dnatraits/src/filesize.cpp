@@ -16,3 +16,13 @@ off_t filesize(const int file_descriptor)
 
   return stat.st_size;
 }
+
+bool is_regular_file(const int file_descriptor)
+{
+  struct stat stat;
+
+  if ( fstat(file_descriptor, &stat) < 0 )
+    throw std::runtime_error("Could not stat file");
+
+  return S_ISREG(stat.st_mode);
+}
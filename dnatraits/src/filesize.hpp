@@ -7,3 +7,4 @@
 #include "export.hpp"
 
 off_t DLL_LOCAL filesize(const int file_descriptor);
+bool DLL_LOCAL is_regular_file(const int file_descriptor);
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "format.hpp"
+
+/*
+ * Bytes to look at when detecting the format of a file.
+ */
+static const size_t SNIFF_SIZE = 1 << 16;
+
+Nucleotide CharToNucleotide[256] = {NONE};
+
+static struct NucleotideTable {
+  NucleotideTable()
+  {
+    CharToNucleotide[static_cast<unsigned>('A')] = A;
+    CharToNucleotide[static_cast<unsigned>('G')] = G;
+    CharToNucleotide[static_cast<unsigned>('C')] = C;
+    CharToNucleotide[static_cast<unsigned>('T')] = T;
+    CharToNucleotide[static_cast<unsigned>('D')] = D;
+    CharToNucleotide[static_cast<unsigned>('I')] = I;
+  }
+} nucleotide_table;
+
+static bool starts_with(const char* s, const char* end, const char* prefix)
+{
+  const size_t len = std::strlen(prefix);
+  return static_cast<size_t>(end - s) >= len &&
+         std::memcmp(s, prefix, len) == 0;
+}
+
+/**
+ * Looks at the comments and the first line after them. VCF files announce
+ * themselves in their meta-information, while the others are told apart by
+ * how the column header or first record is separated.
+ */
+FileFormat detect_format(const char* data, const size_t size)
+{
+  const char* s = data;
+  const char* end = data + std::min(size, SNIFF_SIZE);
+
+  while ( s < end ) {
+    const char* eol = find_newline(s, end);
+
+    if ( starts_with(s, eol, "##fileformat=VCF") ||
+         starts_with(s, eol, "#CHROM") )
+      return FORMAT_VCF;
+
+    if ( *s != '#' && *s != '\n' && *s != '\r' ) {
+      const ptrdiff_t tabs = std::count(s, eol, '\t');
+      const ptrdiff_t commas = std::count(s, eol, ',');
+
+      if ( commas >= 3 )
+        return FORMAT_CSV;
+
+      if ( tabs == 4 )
+        return FORMAT_ANCESTRYDNA;
+
+      if ( tabs >= 9 )
+        return FORMAT_VCF;
+
+      return FORMAT_23ANDME;
+    }
+
+    s = eol + 1;
+  }
+
+  return FORMAT_23ANDME;
+}
@@ -0,0 +1,586 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_FORMAT_H
+#define DNA_FORMAT_H
+
+#include <cctype>
+#include <cstddef>
+#include <vector>
+
+#include "dnatraits.hpp"
+#include "scan.hpp"
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+DLL_LOCAL extern Nucleotide CharToNucleotide[256];
+
+/*
+ * What a tokenizer found on a line.
+ */
+enum LineKind {
+  LINE_SKIPPED,
+  LINE_RSID,
+  LINE_INTERNAL // 23andMe internal ID
+};
+
+/*
+ * Parser policies. The tokenizers call check() with each condition a valid
+ * record must meet, and drop the record if it returns false.
+ *
+ * Unchecked trusts its input, so all of the checks compile away and leave
+ * the bare tokenizers.
+ */
+struct DLL_LOCAL Unchecked {
+  inline void next_line()
+  {
+  }
+
+  inline bool check(const bool, const char*)
+  {
+    return true;
+  }
+};
+
+/*
+ * Keeps count of lines, and records the line number and reason for each bad
+ * record. Line numbers are relative to where counting started.
+ */
+struct DLL_LOCAL Validating {
+  size_t line;
+  std::vector<ParseError> errors;
+
+  Validating(const size_t first_line = 0) :
+    line(first_line),
+    errors()
+  {
+  }
+
+  inline void next_line()
+  {
+    ++line;
+  }
+
+  inline bool check(const bool ok, const char* reason)
+  {
+    if ( !ok )
+      errors.push_back(ParseError(line, reason));
+    return ok;
+  }
+};
+
+/*
+ * Tokenizers for each of the supported file formats.
+ *
+ * None of them move past a newline. That way, they can work directly on any
+ * buffer whose last line is terminated.
+ */
+
+static inline bool iswhite(const char c)
+{
+  return c=='\t' || c=='\r';
+}
+
+static inline const char*& skipwhite(const char*& s)
+{
+  while ( iswhite(*s) ) ++s;
+  return s;
+}
+
+static inline void skipline(const char*& s, const char* end)
+{
+  s = find_newline(s, end);
+}
+
+/*
+ * Drops the rest of a bad record.
+ */
+static inline LineKind reject(const char*& s, const char* end)
+{
+  skipline(s, end);
+  return LINE_SKIPPED;
+}
+
+static inline bool is_rsid(const char* s)
+{
+  return s[0]=='r' && s[1]=='s' && isdigit(s[2]);
+}
+
+static inline bool is_internal(const char* s)
+{
+  return s[0]=='i' && isdigit(s[1]);
+}
+
+/*
+ * True for genotype letters, including the "-" of no-calls.
+ */
+static inline bool is_allele(const char c)
+{
+  return CharToNucleotide[static_cast<unsigned char>(c)] != NONE || c == '-';
+}
+
+/*
+ * Skips the prefix of an RSID or internal ID, and tells which it was.
+ */
+static inline LineKind skip_id_prefix(const char*& s)
+{
+  if ( is_rsid(s) ) {
+    s += 2;
+    return LINE_RSID;
+  }
+
+  if ( is_internal(s) ) {
+    s += 1;
+    return LINE_INTERNAL;
+  }
+
+  return LINE_SKIPPED;
+}
+
+static inline uint32_t parse_uint32(const char*& s, const char* end)
+{
+  uint32_t n = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if ( end - s >= 8 ) {
+    unsigned len;
+    n = parse_digits8(s, len);
+
+    if ( len < 8 )
+      return n;
+  }
+#endif
+
+  while ( isdigit(*s) )
+    n = n*10 - '0' + *s++;
+
+  return n;
+}
+
+/*
+ * Like parse_uint32(), but also gives the number of digits read, and
+ * whether there were more than ten of them or the number didn't fit in 32
+ * bits. Digits past the tenth are still consumed.
+ */
+static inline uint32_t parse_uint32(const char*& s, const char* end,
+                                    size_t& digits, bool& overflow)
+{
+  const char* start = s;
+  uint64_t n = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if ( end - s >= 8 ) {
+    unsigned len;
+    n = parse_digits8(s, len);
+
+    if ( len < 8 ) {
+      digits = len;
+      overflow = false;
+      return static_cast<uint32_t>(n);
+    }
+  }
+#endif
+
+  while ( isdigit(*s) )
+    n = n*10 - '0' + *s++;
+
+  digits = s - start;
+  overflow = digits > 10 || n > 0xffffffffULL;
+  return static_cast<uint32_t>(n);
+}
+
+/*
+ * True for an "rs" or "i" prefix with no number after it. Such a line is a
+ * bad record, rather than a header or comment.
+ */
+template <class Sep>
+static inline bool is_bare_id(const char* s)
+{
+  return (s[0]=='r' && s[1]=='s' && Sep::is_sep(s[2])) ||
+         (s[0]=='i' && Sep::is_sep(s[1]));
+}
+
+static inline Nucleotide parse_nucleotide(const char*& s)
+{
+  const Nucleotide n = CharToNucleotide[static_cast<unsigned char>(*s)];
+  s += (*s != '\n');
+  return n;
+}
+
+static inline Chromosome parse_chromo(const char*& s, const char* end)
+{
+  if ( isdigit(*s) ) {
+    const uint32_t n = parse_uint32(s, end);
+    return n <= CHR_Y? static_cast<Chromosome>(n) : NO_CHR;
+  }
+
+  switch ( *s ) {
+    case 'M': s += 1 + (s[1] == 'T'); // skip T in "MT"
+              return CHR_MT;
+    case 'X': ++s;
+              return CHR_X;
+    case 'Y': ++s;
+              return CHR_Y;
+    default:  return NO_CHR;
+  }
+}
+
+static inline Genotype parse_genotype(const char*& s)
+{
+  // Haploid calls (X, Y and MT for males) only have one nucleotide, in which
+  // case the second one becomes NONE.
+  Nucleotide first = parse_nucleotide(s);
+  Nucleotide second = parse_nucleotide(s);
+  return Genotype(first, second);
+}
+
+/*
+ * Separators of the 23andMe format.
+ */
+struct DLL_LOCAL TabSeparated {
+  static inline void skip_quote(const char*&)
+  {
+  }
+
+  static inline bool is_sep(const char c)
+  {
+    return iswhite(c);
+  }
+
+  static inline const char*& skip(const char*& s)
+  {
+    return skipwhite(s);
+  }
+};
+
+/*
+ * Separators of the FamilyTreeDNA and MyHeritage formats, which quote
+ * their fields.
+ */
+struct DLL_LOCAL CommaSeparated {
+  static inline void skip_quote(const char*& s)
+  {
+    s += (*s == '"');
+  }
+
+  static inline bool is_sep(const char c)
+  {
+    return c==',' || c=='"' || iswhite(c);
+  }
+
+  static inline const char*& skip(const char*& s)
+  {
+    while ( is_sep(*s) ) ++s;
+    return s;
+  }
+};
+
+/*
+ * True if only separators are left on the line.
+ */
+template <class Sep>
+static inline bool at_end_of_line(const char* s)
+{
+  while ( Sep::is_sep(*s) ) ++s;
+  return *s == '\n';
+}
+
+/*
+ * ID, chromosome, position and genotype columns.
+ */
+template <class Sep>
+struct DLL_LOCAL ColumnFormat {
+  template <class Policy>
+  static inline LineKind parse_line(const char*& s, const char* end,
+                                    RSID& id, SNP& snp, Policy& policy)
+  {
+    Sep::skip_quote(s);
+
+    const LineKind kind = skip_id_prefix(s);
+
+    // Skip anything other than an RSID or internal ID
+    if ( kind == LINE_SKIPPED ) {
+      policy.check(!is_bare_id<Sep>(s), "Invalid ID");
+      skipline(s, end);
+      return kind;
+    }
+
+    size_t digits;
+    bool overflow;
+    id = parse_uint32(s, end, digits, overflow);
+
+    // Zero is the hash tables' empty key
+    if ( !policy.check(Sep::is_sep(*s) && id != 0 && !overflow,
+                       "Invalid ID") )
+      return reject(s, end);
+
+    snp.chromosome = parse_chromo(Sep::skip(s), end);
+
+    if ( !policy.check(snp.chromosome != NO_CHR && Sep::is_sep(*s),
+                       "Invalid chromosome") )
+      return reject(s, end);
+
+    Sep::skip(s);
+    snp.position = parse_uint32(s, end, digits, overflow);
+
+    if ( !policy.check(digits > 0 && !overflow && Sep::is_sep(*s),
+                       "Invalid position") )
+      return reject(s, end);
+
+    const char* field = Sep::skip(s);
+
+    if ( !policy.check(is_allele(field[0]) &&
+                       at_end_of_line<Sep>(field + 1 + is_allele(field[1])),
+                       "Invalid genotype") )
+      return reject(s, end);
+
+    snp.genotype = parse_genotype(s);
+
+    if ( *s != '\n' )
+      skipline(s, end);
+
+    return kind;
+  }
+};
+
+/*
+ * 23andMe: rsid, chromosome, position and genotype, separated by tabs.
+ */
+typedef ColumnFormat<TabSeparated> Format23andMe;
+
+/*
+ * FamilyTreeDNA and MyHeritage: the same columns as 23andMe, but comma
+ * separated and usually quoted.
+ */
+typedef ColumnFormat<CommaSeparated> FormatCSV;
+
+/*
+ * AncestryDNA: rsid, chromosome, position and the two alleles in separate
+ * columns. Chromosomes are numbered, with 23 for X, 24 for Y, 25 for the
+ * pseudoautosomal region of X and 26 for MT. No-calls are zeros.
+ */
+struct DLL_LOCAL FormatAncestryDNA {
+  static inline Chromosome parse_chromosome(const char*& s, const char* end)
+  {
+    if ( !isdigit(*s) )
+      return parse_chromo(s, end);
+
+    const uint32_t n = parse_uint32(s, end);
+
+    switch ( n ) {
+      case 23: return CHR_X;
+      case 24: return CHR_Y;
+      case 25: return CHR_X;
+      case 26: return CHR_MT;
+      default: return n <= CHR22? static_cast<Chromosome>(n) : NO_CHR;
+    }
+  }
+
+  static inline bool is_call(const char c)
+  {
+    return is_allele(c) || c == '0';
+  }
+
+  template <class Policy>
+  static inline LineKind parse_line(const char*& s, const char* end,
+                                    RSID& rsid, SNP& snp, Policy& policy)
+  {
+    if ( !is_rsid(s) ) {
+      policy.check(!is_bare_id<TabSeparated>(s), "Invalid ID");
+      skipline(s, end);
+      return LINE_SKIPPED;
+    }
+
+    size_t digits;
+    bool overflow;
+    rsid = parse_uint32(s+=2, end, digits, overflow);
+
+    if ( !policy.check(iswhite(*s) && rsid != 0 && !overflow, "Invalid ID") )
+      return reject(s, end);
+
+    snp.chromosome = parse_chromosome(skipwhite(s), end);
+
+    if ( !policy.check(snp.chromosome != NO_CHR && iswhite(*s),
+                       "Invalid chromosome") )
+      return reject(s, end);
+
+    skipwhite(s);
+    snp.position = parse_uint32(s, end, digits, overflow);
+
+    if ( !policy.check(digits > 0 && !overflow && iswhite(*s),
+                       "Invalid position") )
+      return reject(s, end);
+
+    const Nucleotide first = parse_nucleotide(skipwhite(s));
+    const char* field = s;
+    const Nucleotide second = parse_nucleotide(skipwhite(s));
+
+    if ( !policy.check(is_call(field[-1]) && iswhite(field[0]) &&
+                       is_call(s[-1]) && at_end_of_line<TabSeparated>(s),
+                       "Invalid alleles") )
+      return reject(s, end);
+
+    snp.genotype = Genotype(first, second);
+
+    if ( *s != '\n' )
+      skipline(s, end);
+
+    return LINE_RSID;
+  }
+};
+
+/*
+ * VCF: only records with an rs-number in the ID column are used, and the
+ * genotype is taken from the GT field of the first sample. Alleles that
+ * are longer or shorter than the reference are reported as insertions and
+ * deletions, like 23andMe does.
+ */
+struct DLL_LOCAL FormatVCF {
+  enum { MAX_ALLELES = 8 };
+
+  static inline void next_field(const char*& s, const char* end)
+  {
+    s = find_field_end(s, end);
+    s += (*s == '\t');
+  }
+
+  static inline Nucleotide allele(const char* s, const size_t len,
+                                  const size_t ref_len)
+  {
+    if ( *s == '<' || *s == '*' || *s == '.' )
+      return NONE; // symbolic, overlapping deletion or missing
+
+    if ( len == 1 && ref_len == 1 )
+      return CharToNucleotide[static_cast<unsigned char>(*s)];
+
+    return len > ref_len? I : len < ref_len? D : NONE;
+  }
+
+  static inline Nucleotide call(const char*& s, const Nucleotide* alleles,
+                                const unsigned count)
+  {
+    if ( !isdigit(*s) ) {
+      s += (*s == '.');
+      return NONE;
+    }
+
+    unsigned n = 0;
+
+    while ( isdigit(*s) )
+      n = n*10 - '0' + *s++;
+
+    return n < count? alleles[n] : NONE;
+  }
+
+  template <class Policy>
+  static inline LineKind parse_line(const char*& s, const char* end,
+                                    RSID& rsid, SNP& snp, Policy& policy)
+  {
+    if ( *s == '#' ) {
+      skipline(s, end);
+      return LINE_SKIPPED;
+    }
+
+    if ( s[0]=='c' && s[1]=='h' && s[2]=='r' )
+      s += 3;
+
+    snp.chromosome = parse_chromo(s, end);
+    const bool chromosome_ok = snp.chromosome != NO_CHR && *s == '\t';
+    next_field(s, end);
+
+    size_t digits;
+    bool overflow;
+    snp.position = parse_uint32(s, end, digits, overflow);
+    const bool position_ok = digits > 0 && !overflow && *s == '\t';
+    next_field(s, end);
+
+    if ( !is_rsid(s) ) {
+      policy.check(!(s[0]=='r' && s[1]=='s' && (s[2]=='\t' || s[2]==';')),
+                   "Invalid ID");
+      skipline(s, end);
+      return LINE_SKIPPED;
+    }
+
+    rsid = parse_uint32(s+=2, end, digits, overflow);
+
+    if ( !policy.check(chromosome_ok, "Invalid chromosome") ||
+         !policy.check(position_ok, "Invalid position") ||
+         !policy.check((*s == '\t' || *s == ';') && rsid != 0 && !overflow,
+                       "Invalid ID") )
+      return reject(s, end);
+
+    next_field(s, end);
+
+    // Reference and alternate alleles
+    Nucleotide alleles[MAX_ALLELES];
+    unsigned count = 0;
+
+    const char* ref = s;
+    s = find_field_end(s, end);
+    const size_t ref_len = s - ref;
+
+    if ( !policy.check(ref_len > 0 && *s == '\t', "Invalid reference allele") )
+      return reject(s, end);
+
+    alleles[count++] = allele(ref, ref_len, ref_len);
+    s += (*s == '\t');
+
+    while ( *s != '\t' && *s != '\n' ) {
+      const char* alt = s;
+      while ( *s != ',' && *s != '\t' && *s != '\n' ) ++s;
+
+      if ( count < MAX_ALLELES )
+        alleles[count++] = allele(alt, s - alt, ref_len);
+
+      s += (*s == ',');
+    }
+    s += (*s == '\t');
+
+    next_field(s, end); // QUAL
+    next_field(s, end); // FILTER
+    next_field(s, end); // INFO
+
+    // Find the position of GT among the FORMAT keys
+    int gt = -1;
+
+    for ( int key = 0; *s != '\t' && *s != '\n'; ++key ) {
+      if ( s[0]=='G' && s[1]=='T' && (s[2]==':' || s[2]=='\t') )
+        gt = key;
+
+      while ( *s != ':' && *s != '\t' && *s != '\n' ) ++s;
+      s += (*s == ':');
+    }
+    s += (*s == '\t');
+
+    snp.genotype = NN;
+
+    if ( gt >= 0 ) {
+      for ( ; gt > 0 && *s != '\t' && *s != '\n'; ++s )
+        gt -= (*s == ':');
+
+      if ( gt == 0 ) {
+        const Nucleotide first = call(s, alleles, count);
+        Nucleotide second = NONE; // haploid
+
+        if ( *s == '/' || *s == '|' )
+          second = call(++s, alleles, count);
+
+        snp.genotype = Genotype(first, second);
+      }
+    }
+
+    if ( !policy.check(gt == 0 && (*s == ':' || *s == '\t' || *s == '\r' ||
+                                   *s == '\n'), "Invalid genotype") )
+      return reject(s, end);
+
+    if ( *s != '\n' )
+      skipline(s, end);
+
+    return LINE_RSID;
+  }
+};
+
+#endif
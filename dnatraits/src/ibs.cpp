@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "ibs.hpp"
+
+/*
+ * Samples per side of a tile.
+ */
+static const size_t TILE = 64;
+
+/*
+ * Plane words per sample swept at a time. Two tiles' worth of planes then
+ * take 256 kB, which stays in L2.
+ */
+static const size_t CHUNK = 128;
+
+static const std::uint64_t EVEN_BITS = 0x5555555555555555ULL;
+
+/*
+ * Gathers the even bits of x into its lower half.
+ */
+static inline std::uint64_t even_bits(std::uint64_t x)
+{
+#if defined(__BMI2__)
+  return _pext_u64(x, EVEN_BITS);
+#else
+  x &= EVEN_BITS;
+  x = (x | (x >> 1)) & 0x3333333333333333ULL;
+  x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+  x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+  x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+  x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+  return x;
+#endif
+}
+
+static inline std::uint64_t word(const CodeRow& row, const size_t n)
+{
+  return n < row.size? row.words[n] : 0;
+}
+
+/*
+ * Splits 64 markers of codes, starting at plane word w, into a high and a
+ * low bit plane. A homozygote for the first allele is low only, the
+ * heterozygote high only, and the other homozygote both.
+ */
+static void planes(const CodeRow& row, const size_t w, const size_t count,
+    const std::vector<std::uint64_t>& mask, std::uint64_t* out)
+{
+  for ( size_t n = 0; n < count; ++n ) {
+    const std::uint64_t a = word(row, 2*(w + n));
+    const std::uint64_t b = word(row, 2*(w + n) + 1);
+    const std::uint64_t m = mask[w + n];
+
+    out[2*n] = (even_bits(a >> 1) | (even_bits(b >> 1) << 32)) & m;
+    out[2*n + 1] = (even_bits(a) | (even_bits(b) << 32)) & m;
+  }
+}
+
+/*
+ * Markers called in both, with equal genotypes, and with opposite
+ * homozygotes, which is where both low bits are set and the high ones
+ * differ.
+ */
+static inline void compare(const std::uint64_t* x, const std::uint64_t* y,
+    const size_t count, std::uint32_t& both, std::uint32_t& ibs2,
+    std::uint32_t& ibs0)
+{
+  std::uint32_t b = 0, two = 0, zero = 0;
+
+  for ( size_t n = 0; n < count; ++n ) {
+    const std::uint64_t hx = x[2*n], lx = x[2*n + 1];
+    const std::uint64_t hy = y[2*n], ly = y[2*n + 1];
+
+    const std::uint64_t called = (hx | lx) & (hy | ly);
+    b += __builtin_popcountll(called);
+    two += __builtin_popcountll(called & ~((hx ^ hy) | (lx ^ ly)));
+    zero += __builtin_popcountll(lx & ly & (hx ^ hy));
+  }
+
+  both += b;
+  ibs2 += two;
+  ibs0 += zero;
+}
+
+static void tile(const std::vector<CodeRow>& rows,
+    const std::vector<std::uint64_t>& mask,
+    const size_t i0, const size_t ni, const size_t j0, const size_t nj,
+    std::vector<std::uint64_t>& bufi, std::vector<std::uint64_t>& bufj,
+    std::vector<std::uint32_t>& both, std::vector<IBSCounts>& out)
+{
+  const bool diagonal = i0 == j0;
+  const size_t words = mask.size();
+
+  std::fill(both.begin(), both.end(), 0);
+  for ( auto& c : out )
+    c.ibs0 = c.ibs1 = c.ibs2 = 0;
+
+  for ( size_t w = 0; w < words; w += CHUNK ) {
+    const size_t count = std::min(CHUNK, words - w);
+
+    for ( size_t i = 0; i < ni; ++i )
+      planes(rows[i0 + i], w, count, mask, &bufi[2*CHUNK*i]);
+
+    if ( !diagonal )
+      for ( size_t j = 0; j < nj; ++j )
+        planes(rows[j0 + j], w, count, mask, &bufj[2*CHUNK*j]);
+
+    const std::vector<std::uint64_t>& cols = diagonal? bufi : bufj;
+
+    for ( size_t i = 0; i < ni; ++i )
+      for ( size_t j = diagonal? i + 1 : 0; j < nj; ++j ) {
+        IBSCounts& c = out[i*nj + j];
+        compare(&bufi[2*CHUNK*i], &cols[2*CHUNK*j], count,
+                both[i*nj + j], c.ibs2, c.ibs0);
+      }
+  }
+
+  for ( size_t n = 0; n < ni*nj; ++n )
+    out[n].ibs1 = both[n] - out[n].ibs2 - out[n].ibs0;
+}
+
+void pairwise_ibs(const std::vector<CodeRow>& rows,
+                  const std::vector<std::uint64_t>& mask,
+                  unsigned threads, const IBSSink& sink)
+{
+  const size_t blocks = (rows.size() + TILE - 1) / TILE;
+
+  std::vector<std::pair<size_t, size_t> > tiles;
+  for ( size_t bi = 0; bi < blocks; ++bi )
+    for ( size_t bj = bi; bj < blocks; ++bj )
+      tiles.push_back(std::make_pair(bi, bj));
+
+  if ( threads == 0 )
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::min<size_t>(threads,
+        std::max<size_t>(1, tiles.size())));
+
+  std::atomic<size_t> next(0);
+  std::mutex lock;
+  std::exception_ptr error;
+
+  auto work = [&]() {
+    std::vector<std::uint64_t> bufi(2*CHUNK*TILE), bufj(2*CHUNK*TILE);
+    std::vector<std::uint32_t> both(TILE*TILE);
+    std::vector<IBSCounts> out(TILE*TILE);
+
+    for ( size_t t; (t = next++) < tiles.size(); ) {
+      const size_t i0 = tiles[t].first*TILE;
+      const size_t j0 = tiles[t].second*TILE;
+      const size_t ni = std::min(TILE, rows.size() - i0);
+      const size_t nj = std::min(TILE, rows.size() - j0);
+
+      out.resize(ni*nj);
+      both.resize(ni*nj);
+      tile(rows, mask, i0, ni, j0, nj, bufi, bufj, both, out);
+
+      std::lock_guard<std::mutex> guard(lock);
+      if ( error )
+        return;
+      try {
+        sink(i0, j0, ni, nj, out.data());
+      } catch ( ... ) {
+        error = std::current_exception();
+        return;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for ( unsigned n = 1; n < threads; ++n )
+    workers.push_back(std::thread(work));
+
+  work();
+
+  for ( auto& worker : workers )
+    worker.join();
+
+  if ( error )
+    std::rethrow_exception(error);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_IBS_H
+#define DNA_IBS_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "dnatraits.hpp"
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * A sample's genotype codes, two bits per marker and 32 markers per word:
+ * zero for no call, one and three for the homozygotes and two for the
+ * heterozygote. Words past the end are taken to be zero.
+ */
+struct DLL_LOCAL CodeRow {
+  const std::uint64_t* words;
+  size_t size;
+};
+
+/*
+ * Receives the counts for samples [i, i + rows) against [j, j + cols), in
+ * row-major order. Only pairs of different samples with the first below the
+ * second are set.
+ */
+typedef std::function<void(size_t i, size_t j, size_t rows, size_t cols,
+                           const IBSCounts* tile)> IBSSink;
+
+/*
+ * Counts identity by state for all pairs of rows, over the markers set in
+ * mask, which has one bit per marker. The work is cut into tiles of
+ * samples, which are handed out to the threads, and each tile is swept a
+ * chunk of markers at a time so its samples stay in cache. The sink is
+ * called for each tile as it's done, one at a time.
+ */
+void pairwise_ibs(const std::vector<CodeRow>& rows,
+                  const std::vector<std::uint64_t>& mask,
+                  unsigned threads, const IBSSink& sink);
+
+#endif
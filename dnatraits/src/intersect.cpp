@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "intersect.hpp"
+
+/*
+ * Size ratio above which galloping beats merging.
+ */
+static const size_t GALLOP_RATIO = 32;
+
+/*
+ * Don't start threads for less than this many IDs each.
+ */
+static const size_t MIN_PER_THREAD = 1 << 15;
+
+static inline void emit(Match* out, size_t& n, const size_t i, const size_t j)
+{
+  if ( out != NULL ) {
+    out[n].a = static_cast<std::uint32_t>(i);
+    out[n].b = static_cast<std::uint32_t>(j);
+  }
+  ++n;
+}
+
+/*
+ * Looks up each ID of a in b, doubling the step from where the last one was
+ * found until it's passed, and then doing a binary search in the last step.
+ */
+static size_t gallop(const RSID* a, const size_t na,
+                     const RSID* b, const size_t nb,
+                     Match* out, const bool swapped)
+{
+  size_t n = 0;
+  size_t lo = 0;
+
+  for ( size_t i = 0; i < na && lo < nb; ++i ) {
+    const RSID id = a[i];
+
+    size_t step = 1;
+    size_t hi = lo;
+    while ( hi < nb && b[hi] < id ) {
+      lo = hi + 1;
+      hi += step;
+      step <<= 1;
+    }
+
+    const RSID* p = std::lower_bound(b + lo, b + std::min(hi + 1, nb), id);
+    lo = p - b;
+
+    if ( lo < nb && *p == id ) {
+      if ( swapped )
+        emit(out, n, lo, i);
+      else
+        emit(out, n, i, lo);
+      ++lo;
+    }
+  }
+
+  return n;
+}
+
+/*
+ * Merges a and b, comparing blocks of four IDs against each other. An ID can
+ * only match once, since both arrays are unique, so a block is compared
+ * against successive blocks of the other array until its largest ID is
+ * passed. What's left at the end is merged one ID at a time.
+ */
+static size_t merge(const RSID* a, const size_t na,
+                    const RSID* b, const size_t nb,
+                    Match* out)
+{
+  size_t n = 0;
+  size_t i = 0;
+  size_t j = 0;
+
+#if defined(__SSE2__)
+  while ( i + 4 <= na && j + 4 <= nb ) {
+    const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+
+    // Compares each lane of a with every lane of b by rotating b
+    const __m128i eq0 = _mm_cmpeq_epi32(va, vb);
+    const __m128i eq1 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39));
+    const __m128i eq2 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4e));
+    const __m128i eq3 = _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93));
+
+    const __m128i any = _mm_or_si128(_mm_or_si128(eq0, eq1),
+                                     _mm_or_si128(eq2, eq3));
+    unsigned mask = _mm_movemask_ps(_mm_castsi128_ps(any));
+
+    while ( mask ) {
+      const unsigned k = __builtin_ctz(mask);
+      mask &= mask - 1;
+
+      const RSID id = a[i + k];
+      const size_t m = (b[j] == id)? 0 :
+                       (b[j + 1] == id)? 1 :
+                       (b[j + 2] == id)? 2 : 3;
+      emit(out, n, i + k, j + m);
+    }
+
+    const RSID amax = a[i + 3];
+    const RSID bmax = b[j + 3];
+    i += (amax <= bmax)? 4 : 0;
+    j += (bmax <= amax)? 4 : 0;
+  }
+#endif
+
+  while ( i < na && j < nb ) {
+    if ( a[i] == b[j] ) {
+      emit(out, n, i, j);
+      ++i;
+      ++j;
+    } else if ( a[i] < b[j] )
+      ++i;
+    else
+      ++j;
+  }
+
+  return n;
+}
+
+static size_t intersect_range(const RSID* a, const size_t na,
+                              const RSID* b, const size_t nb,
+                              Match* out)
+{
+  if ( na*GALLOP_RATIO < nb )
+    return gallop(a, na, b, nb, out, false);
+
+  if ( nb*GALLOP_RATIO < na )
+    return gallop(b, nb, a, na, out, true);
+
+  return merge(a, na, b, nb, out);
+}
+
+size_t intersect_sorted(const RSID* a, const size_t na,
+                        const RSID* b, const size_t nb,
+                        Match* out, unsigned threads)
+{
+  if ( threads == 0 )
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  threads = static_cast<unsigned>(
+      std::min<size_t>(threads, std::max<size_t>(1, na / MIN_PER_THREAD)));
+
+  if ( threads <= 1 )
+    return intersect_range(a, na, b, nb, out);
+
+  // Each range of a is intersected with the part of b it overlaps
+  std::vector<size_t> astart(threads + 1);
+  std::vector<size_t> bstart(threads + 1);
+
+  for ( unsigned t = 0; t <= threads; ++t ) {
+    astart[t] = na*t / threads;
+    bstart[t] = (t == threads)? nb :
+      std::lower_bound(b, b + nb, a[astart[t]]) - b;
+  }
+
+  std::vector<std::vector<Match> > found(threads);
+  std::vector<size_t> counts(threads);
+  std::vector<std::thread> workers;
+
+  for ( unsigned t = 0; t < threads; ++t ) {
+    workers.push_back(std::thread([&, t]() {
+      const size_t an = astart[t + 1] - astart[t];
+      const size_t bn = bstart[t + 1] - bstart[t];
+
+      if ( out != NULL )
+        found[t].resize(std::min(an, bn));
+
+      counts[t] = intersect_range(a + astart[t], an, b + bstart[t], bn,
+                                  out != NULL? found[t].data() : NULL);
+    }));
+  }
+
+  for ( auto& w : workers )
+    w.join();
+
+  size_t n = 0;
+  for ( unsigned t = 0; t < threads; ++t ) {
+    if ( out != NULL )
+      for ( size_t k = 0; k < counts[t]; ++k ) {
+        out[n + k].a = found[t][k].a + static_cast<std::uint32_t>(astart[t]);
+        out[n + k].b = found[t][k].b + static_cast<std::uint32_t>(bstart[t]);
+      }
+    n += counts[t];
+  }
+
+  return n;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_INTERSECT_H
+#define DNA_INTERSECT_H
+
+#include <cstdint>
+
+#include "dnatraits.hpp"
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * Positions of an ID found in both of two arrays.
+ */
+struct DLL_LOCAL Match {
+  std::uint32_t a;
+  std::uint32_t b;
+};
+
+/*
+ * Finds the IDs common to the sorted, unique arrays a and b, and returns how
+ * many there are. If out isn't NULL, their positions are stored there in
+ * order, and it must have room for min(na, nb) matches.
+ *
+ * When one array is much smaller than the other, each of its IDs is found in
+ * the larger one by galloping. Otherwise, the arrays are merged a block of
+ * four IDs at a time, comparing all pairs in a block with vector
+ * instructions.
+ *
+ * With more than one thread, a is cut into that many ranges which are
+ * intersected in parallel. Zero threads means one per core.
+ */
+size_t intersect_sorted(const RSID* a, const size_t na,
+                        const RSID* b, const size_t nb,
+                        Match* out, unsigned threads = 1);
+
+#endif
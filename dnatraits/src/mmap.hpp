@@ -3,6 +3,9 @@
  * Distributed under the GPL v3 or later. See COPYING.
  */
 
+#ifndef DNA_MMAP_H
+#define DNA_MMAP_H
+
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/mman.h>
@@ -27,4 +30,14 @@ public:
   inline void* ptr() const {
     return p;
   }
+
+  /*
+   * Passes an madvise(2) hint for the whole mapping. Returns false if the
+   * kernel didn't take it, which is harmless.
+   */
+  inline bool advise(const int advice) const {
+    return madvise(p, l, advice) == 0;
+  }
 };
+
+#endif
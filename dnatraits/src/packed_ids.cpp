@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+
+#include "packed_ids.hpp"
+
+const size_t PackedIDs::BLOCK_SIZE;
+const size_t PackedIDs::NOT_FOUND;
+
+static inline std::uint32_t bit_width(std::uint32_t v)
+{
+  std::uint32_t w = 0;
+  while ( v ) {
+    v >>= 1;
+    ++w;
+  }
+  return w;
+}
+
+PackedIDs::PackedIDs() :
+  blocks(),
+  bits(1, 0),
+  count(0)
+{
+}
+
+void PackedIDs::assign(const RSID* ids, const size_t count_)
+{
+  std::vector<Block> b;
+  b.reserve((count_ + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+  std::uint64_t pos = 0;
+
+  for ( size_t start = 0; start < count_; start += BLOCK_SIZE ) {
+    const size_t len = std::min(BLOCK_SIZE, count_ - start);
+
+    Block block;
+    block.offset = pos;
+    block.head = ids[start];
+    block.width = bit_width(ids[start + len - 1] - ids[start]);
+    b.push_back(block);
+
+    pos += len*block.width;
+  }
+
+  // One extra word, so get() can always read two
+  std::vector<std::uint64_t> packed((pos + 63) / 64 + 1, 0);
+
+  for ( size_t n = 0; n < count_; ++n ) {
+    const Block& block = b[n / BLOCK_SIZE];
+    const std::uint64_t v = ids[n] - block.head;
+    const std::uint64_t at = block.offset + (n % BLOCK_SIZE)*block.width;
+    const unsigned shift = at & 63;
+
+    packed[at >> 6] |= v << shift;
+
+    if ( shift + block.width > 64 )
+      packed[(at >> 6) + 1] |= v >> (64 - shift);
+  }
+
+  blocks.swap(b);
+  bits.swap(packed);
+  count = count_;
+}
+
+size_t PackedIDs::find(const RSID& id) const
+{
+  const size_t block = locate(id);
+  return block != NOT_FOUND? find_in(block, id) : NOT_FOUND;
+}
+
+size_t PackedIDs::locate(const RSID& id) const
+{
+  if ( count == 0 || id < blocks[0].head )
+    return NOT_FOUND;
+
+  // The last block starting at or before the ID
+  const Block* block = blocks.data();
+  size_t n = blocks.size();
+
+  while ( n > 1 ) {
+    const size_t half = n / 2;
+    block = (block[half].head <= id)? block + half : block;
+    n -= half;
+  }
+
+  // The block's offsets take up width words
+  const std::uint64_t* p = &bits[block->offset >> 6];
+  __builtin_prefetch(p);
+  __builtin_prefetch(p + block->width / 2);
+  __builtin_prefetch(p + block->width);
+
+  return block - blocks.data();
+}
+
+size_t PackedIDs::find_in(const size_t index, const RSID& id) const
+{
+  const Block* block = &blocks[index];
+  const size_t first = index * BLOCK_SIZE;
+  const std::uint32_t offset = id - block->head;
+  size_t lo = 0;
+  size_t n = std::min(BLOCK_SIZE, count - first);
+
+  while ( n > 1 ) {
+    const size_t half = n / 2;
+    lo = (get(*block, lo + half) <= offset)? lo + half : lo;
+    n -= half;
+  }
+
+  return get(*block, lo) == offset? first + lo : NOT_FOUND;
+}
+
+RSID PackedIDs::operator[](const size_t index) const
+{
+  const Block& block = blocks[index / BLOCK_SIZE];
+  return block.head + get(block, index % BLOCK_SIZE);
+}
+
+std::vector<RSID> PackedIDs::unpack() const
+{
+  std::vector<RSID> ids(count);
+
+  for ( size_t n = 0; n < count; ++n )
+    ids[n] = (*this)[n];
+
+  return ids;
+}
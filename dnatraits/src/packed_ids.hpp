@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_PACKED_IDS_H
+#define DNA_PACKED_IDS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "dnatraits.hpp"
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * A sorted set of IDs, compressed with a two-level index. The IDs are cut
+ * into blocks of BLOCK_SIZE, and each block stores its first ID in full and
+ * the rest as offsets from it, packed with just enough bits for the largest
+ * one. For a 23andMe file, that's around 20 bits per ID instead of 32, and
+ * far less than a hash table needs.
+ *
+ * Lookups do a branch-free binary search over the block heads, and then
+ * another one over the packed offsets in the block.
+ */
+class DLL_LOCAL PackedIDs {
+public:
+  static const size_t BLOCK_SIZE = 64;
+  static const size_t NOT_FOUND = static_cast<size_t>(-1);
+
+  PackedIDs();
+
+  /*
+   * Replaces the contents with the given IDs, which must be sorted and
+   * unique.
+   */
+  void assign(const RSID* ids, const size_t count);
+
+  /*
+   * Returns the index of the given ID, or NOT_FOUND.
+   */
+  size_t find(const RSID& id) const;
+
+  /*
+   * The two halves of find(), for overlapping several lookups. locate()
+   * returns the block the ID would be in, or NOT_FOUND, and starts loading
+   * it into cache. find_in() then searches the block.
+   */
+  size_t locate(const RSID& id) const;
+  size_t find_in(const size_t block, const RSID& id) const;
+
+  /*
+   * Returns the ID at the given index.
+   */
+  RSID operator[](const size_t index) const;
+
+  inline size_t size() const {
+    return count;
+  }
+
+  /*
+   * Returns the IDs uncompressed, in order.
+   */
+  std::vector<RSID> unpack() const;
+
+private:
+  struct Block {
+    std::uint64_t offset; // of the packed offsets, in bits
+    RSID head;
+    std::uint32_t width; // bits per offset
+  };
+
+  std::vector<Block> blocks;
+  std::vector<std::uint64_t> bits;
+  size_t count;
+
+  inline std::uint32_t get(const Block& b, const size_t n) const {
+    const std::uint64_t pos = b.offset + n*b.width;
+    const size_t word = pos >> 6;
+    const unsigned shift = pos & 63;
+
+    // There is always a word of padding at the end, and the double shift
+    // keeps a zero shift from being undefined.
+    const std::uint64_t v = (bits[word] >> shift) |
+                            ((bits[word + 1] << 1) << (63 - shift));
+
+    return static_cast<std::uint32_t>(
+        v & ((static_cast<std::uint64_t>(1) << b.width) - 1));
+  }
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <stdexcept>
+#include <type_traits>
+
+#include "dnatraits.hpp"
+
+static_assert(sizeof(PackedSNP) == 8 && alignof(PackedSNP) == 8,
+              "PackedSNP must be one aligned word");
+
+static_assert(std::is_trivially_copyable<PackedSNP>::value &&
+              std::is_trivially_copyable<SNP>::value,
+              "SNP records must be trivially copyable");
+
+static const std::uint64_t MAX_POSITION = 0xfffffff;
+
+/*
+ * Conversions between nucleotide pairs and their codes, numbered as in
+ * util/genopairs.py.
+ */
+static struct GenotypeCodes {
+  unsigned char code[7][7]; // by Nucleotide
+  Genotype genotype[32];
+  unsigned char complement[32];
+
+  GenotypeCodes()
+  {
+    // Alphabetical, with no-calls first
+    const Nucleotide order[] = {NONE, A, C, D, G, I, T};
+    unsigned n = 1;
+
+    for ( unsigned i = 0; i < 7; ++i )
+      for ( unsigned j = i; j < 7; ++j, ++n ) {
+        code[order[i]][order[j]] = code[order[j]][order[i]] = n;
+
+        // Haploid calls are stored with the no-call second
+        genotype[n] = i == 0? Genotype(order[j], NONE) :
+                              Genotype(order[i], order[j]);
+      }
+
+    for ( ; n < 32; ++n )
+      genotype[n] = Genotype(NONE, NONE);
+
+    complement[0] = 0;
+    for ( n = 1; n < 32; ++n ) {
+      const Genotype c = ~genotype[n];
+      complement[n] = code[c.first][c.second];
+    }
+  }
+} codes;
+
+unsigned PackedSNP::code(const Genotype& g)
+{
+  return codes.code[g.first][g.second];
+}
+
+PackedSNP::PackedSNP(const SNP& snp) :
+  bits(0)
+{
+  if ( snp.position > MAX_POSITION )
+    throw std::out_of_range("Position is too large to pack");
+
+  bits = code(snp.genotype) |
+         static_cast<std::uint64_t>(snp.chromosome) << 5 |
+         static_cast<std::uint64_t>(snp.position) << 10;
+}
+
+Genotype PackedSNP::genotype() const
+{
+  return codes.genotype[code()];
+}
+
+SNP PackedSNP::snp() const
+{
+  return SNP(chromosome(), position(), genotype());
+}
+
+PackedSNP PackedSNP::operator~() const
+{
+  PackedSNP p;
+  p.bits = (bits & ~static_cast<std::uint64_t>(0x1f)) |
+           codes.complement[code()];
+  return p;
+}
+
+bool PackedSNP::operator==(const Genotype& g) const
+{
+  return code() == code(g);
+}
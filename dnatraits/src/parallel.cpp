@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+
+void parallel_for(const size_t count, unsigned threads,
+    const std::function<void(size_t, size_t)>& f)
+{
+  if ( threads == 0 )
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::max<size_t>(1,
+        std::min<size_t>(threads, count)));
+
+  const size_t chunk = (count + threads - 1) / threads;
+  std::vector<std::thread> workers;
+
+  for ( unsigned t = 1; t < threads; ++t )
+    workers.push_back(std::thread(f, std::min(count, t*chunk),
+                                  std::min(count, (t + 1)*chunk)));
+
+  f(0, std::min(count, chunk));
+
+  for ( auto& worker : workers )
+    worker.join();
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_PARALLEL_H
+#define DNA_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * Splits [0, count) into one range per thread, and calls f(begin, end) for
+ * each of them, with the first on the calling thread. Zero threads means
+ * one per hardware thread. The function must not throw.
+ */
+DLL_LOCAL void parallel_for(const size_t count, unsigned threads,
+                            const std::function<void(size_t, size_t)>& f);
+
+#endif
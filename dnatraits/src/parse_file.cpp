@@ -3,134 +3,537 @@
  * Distributed under the GPL v3 or later. See COPYING.
  */
 
+#include <algorithm>
+#include <exception>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
 #include "dnatraits.hpp"
 #include "file.hpp"
 #include "filesize.hpp"
+#include "format.hpp"
 #include "mmap.hpp"
+#include "stream.hpp"
+
+/*
+ * Files smaller than this per thread are not worth splitting up.
+ */
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
 
-static Nucleotide CharToNucleotide[256] = {NONE};
+/*
+ * Bytes to look at when estimating the number of SNPs in a file.
+ */
+static const ptrdiff_t SAMPLE_SIZE = 1 << 16;
 
-static inline void skip_comments(const char*& s)
+static inline void skip_comments(const char*& s, const char* end)
 {
-  while ( *s == '#' )
-    while ( *s++ != '\n' )
-      ; // loop
+  while ( s < end && *s == '#' ) {
+    s = find_newline(s, end);
+    if ( s < end ) ++s;
+  }
 }
 
-static inline bool iswhite(const char c)
+/*
+ * Parses all lines in [s, end), passing each SNP on to the sink. The range
+ * must start at the beginning of a line, and end with a newline.
+ */
+template <class Format, class Policy, class Sink>
+static void parse_lines(const char* s, const char* end, Sink& sink,
+    Policy& policy)
 {
-  return c=='\t' || c=='\n' || c=='\r';
+  RSID id;
+  SNP snp;
+
+  for ( ; s < end && *s; ++s ) {
+    policy.next_line();
+
+    switch ( Format::parse_line(s, end, id, snp, policy) ) {
+      case LINE_RSID:
+        sink.add(id, snp);
+        break;
+      case LINE_INTERNAL:
+        sink.add_internal(id, snp);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if ( s < end ) {
+    policy.next_line();
+    policy.check(false, "Unexpected NUL byte");
+  }
 }
 
-static inline const char*& skipwhite(const char*& s)
+/*
+ * Picks the tokenizer for the format once per range, so the inner loop is
+ * specialized for it.
+ */
+template <class Policy, class Sink>
+static void parse_lines(const FileFormat format, const char* s,
+    const char* end, Sink& sink, Policy& policy)
 {
-  while ( iswhite(*s) ) ++s;
-  return s;
+  switch ( format ) {
+    case FORMAT_ANCESTRYDNA:
+      parse_lines<FormatAncestryDNA>(s, end, sink, policy);
+      break;
+    case FORMAT_CSV:
+      parse_lines<FormatCSV>(s, end, sink, policy);
+      break;
+    case FORMAT_VCF:
+      parse_lines<FormatVCF>(s, end, sink, policy);
+      break;
+    default:
+      parse_lines<Format23andMe>(s, end, sink, policy);
+      break;
+  }
 }
 
-static inline uint32_t parse_uint32(const char*& s)
+/*
+ * Parses a range with validation if given a checker, and with the unchecked
+ * tokenizers otherwise.
+ */
+template <class Sink>
+static void parse_range(const FileFormat format, const char* s,
+    const char* end, Sink& sink, Validating* checks)
 {
-  uint32_t n = 0;
+  if ( checks ) {
+    parse_lines(format, s, end, sink, *checks);
+  } else {
+    Unchecked unchecked;
+    parse_lines(format, s, end, sink, unchecked);
+  }
+}
+
+/*
+ * Inserts SNPs directly into a genome.
+ */
+class GenomeSink {
+  // Local cache of SNPs and RSIDs, for more locality and hence more speed.
+  // Its size is somewhat arbitrary, but shouldn't be too big.
+  enum { SIZE = 200 };
+
+  Genome& genome;
+  SNP snps[SIZE];
+  RSID rsids[SIZE];
+  int i;
+
+public:
+  bool ychromo;
+
+  GenomeSink(Genome& g) :
+    genome(g),
+    i(0),
+    ychromo(false)
+  {
+  }
+
+  inline void add(const RSID& rsid, const SNP& snp)
+  {
+    if ( rsid < genome.first ) genome.first = rsid;
+    if ( rsid > genome.last ) genome.last = rsid;
+
+    ychromo |= (snp.chromosome==CHR_Y && snp.genotype.first!=NONE);
+
+    // Ordinarly, we would just call `genome.insert(rsid, snp)` here, but it's
+    // a tad faster to stage them in an array first, and then flush it to the
+    // hash map when it's full.
+    rsids[i] = rsid;
+    snps[i] = snp;
+
+    if ( ++i == SIZE )
+      flush();
+  }
+
+  inline void add_internal(const InternalID& id, const SNP& snp)
+  {
+    // These are few, so they go straight in
+    ychromo |= (snp.chromosome==CHR_Y && snp.genotype.first!=NONE);
+    genome.insert_internal(id, snp);
+  }
+
+  void flush()
+  {
+    genome.insert_many(rsids, snps, i);
+    i = 0;
+  }
+};
+
+/*
+ * Collects the SNPs of one chunk, so several chunks can be parsed at once and
+ * merged afterwards.
+ */
+struct DLL_LOCAL ChunkSink {
+  std::vector<RSID> rsids;
+  std::vector<SNP> snps;
+  std::vector<InternalID> internal_ids;
+  std::vector<SNP> internal_snps;
+  RSID first;
+  RSID last;
+  bool ychromo;
+  Validating checks; // with line numbers relative to the chunk
+  std::exception_ptr error;
+
+  ChunkSink() :
+    first(0xffffffff),
+    last(0),
+    ychromo(false)
+  {
+  }
+
+  inline void add(const RSID& rsid, const SNP& snp)
+  {
+    if ( rsid < first ) first = rsid;
+    if ( rsid > last ) last = rsid;
+
+    ychromo |= (snp.chromosome==CHR_Y && snp.genotype.first!=NONE);
+
+    rsids.push_back(rsid);
+    snps.push_back(snp);
+  }
+
+  inline void add_internal(const InternalID& id, const SNP& snp)
+  {
+    ychromo |= (snp.chromosome==CHR_Y && snp.genotype.first!=NONE);
+
+    internal_ids.push_back(id);
+    internal_snps.push_back(snp);
+  }
+
+  void parse(const FileFormat format, const char* s, const char* end,
+      const bool validate)
+  {
+    try {
+      // A 23andMe line is a little over 20 bytes
+      rsids.reserve((end - s) / 20);
+      snps.reserve((end - s) / 20);
+      parse_range(format, s, end, *this, validate? &checks : NULL);
+    } catch ( ... ) {
+      error = std::current_exception();
+    }
+  }
+};
+
+static unsigned worker_count(const ParseOptions& options, const size_t bytes)
+{
+  size_t threads = options.threads;
+
+  if ( threads == 0 )
+    threads = std::thread::hardware_concurrency();
+
+  const size_t most = bytes / MIN_CHUNK_SIZE;
+
+  if ( threads > most ) threads = most;
+  if ( threads < 1 ) threads = 1;
+
+  return static_cast<unsigned>(threads);
+}
+
+/*
+ * Splits [s, end) into chunks at line boundaries, parses them concurrently
+ * and inserts the results into the genome in file order. Since insert keeps
+ * the first of any duplicate RSIDs, the outcome is identical to parsing the
+ * whole range in one go, and so are the errors reported to checks, if given.
+ */
+static bool parse_parallel(const FileFormat format, const char* s,
+    const char* end, Genome& genome, const unsigned threads,
+    Validating* checks)
+{
+  std::vector<const char*> bounds(1, s);
+  const size_t step = (end - s) / threads;
+
+  for ( unsigned n = 1; n < threads; ++n ) {
+    const char* p = bounds.back() + step;
+
+    if ( p >= end )
+      break;
+
+    const char* eol = find_newline(p, end);
+
+    if ( eol + 1 >= end )
+      break;
+
+    bounds.push_back(eol + 1);
+  }
+  bounds.push_back(end);
+
+  const size_t chunks = bounds.size() - 1;
+  std::vector<ChunkSink> sinks(chunks);
+  std::vector<std::thread> workers;
+
+  for ( size_t n = 1; n < chunks; ++n )
+    workers.push_back(std::thread(&ChunkSink::parse, &sinks[n], format,
+          bounds[n], bounds[n+1], checks != NULL));
 
-  while ( isdigit(*s) )
-    n = n*10 - '0' + *s++;
+  sinks[0].parse(format, bounds[0], bounds[1], checks != NULL);
+
+  for ( auto& worker : workers )
+    worker.join();
+
+  bool ychromo = false;
 
-  return n;
+  for ( const auto& sink : sinks ) {
+    if ( sink.error )
+      std::rethrow_exception(sink.error);
+
+    if ( sink.first < genome.first ) genome.first = sink.first;
+    if ( sink.last > genome.last ) genome.last = sink.last;
+    ychromo |= sink.ychromo;
+
+    genome.insert_many(sink.rsids.data(), sink.snps.data(),
+                       sink.rsids.size());
+
+    for ( size_t n = 0; n < sink.internal_ids.size(); ++n )
+      genome.insert_internal(sink.internal_ids[n], sink.internal_snps[n]);
+
+    if ( checks ) {
+      for ( const auto& e : sink.checks.errors )
+        checks->errors.push_back(ParseError(checks->line + e.line, e.reason));
+      checks->line += sink.checks.line;
+    }
+  }
+
+  return ychromo;
+}
+
+ParseOptions::ParseOptions(const unsigned threads_, const FileFormat format_) :
+  threads(threads_),
+  format(format_),
+  errors(NULL),
+  advice(ADVISE_NONE)
+{
 }
 
-static inline Nucleotide parse_nucleotide(const char*& s)
+ParseError::ParseError(const size_t line_, const std::string& reason_) :
+  line(line_),
+  reason(reason_)
 {
-  return CharToNucleotide[static_cast<const std::size_t>(*s++)];
 }
 
-static inline Chromosome parse_chromo(const char*& s)
+/*
+ * Estimates the number of SNPs in [s, end) from the lines in its first few
+ * kilobytes, erring slightly on the high side. Comments and 23andMe's
+ * internal IDs aren't counted.
+ */
+static size_t estimate_snps(const char* s, const char* end)
 {
-  if ( isdigit(*s) )
-      return static_cast<Chromosome>(parse_uint32(s));
+  const char* sample_end = end - s > SAMPLE_SIZE? s + SAMPLE_SIZE : end;
+  size_t snps = 0;
 
-  switch ( *s++ ) {
-    case 'M': ++s; // skip T in "MT"
-              return CHR_MT;
-    case 'X': return CHR_X;
-    case 'Y': return CHR_Y;
-    default:  return NO_CHR;
+  for ( const char* p = s; p < sample_end; ++p ) {
+    if ( *p != '#' && *p != 'i' ) ++snps;
+    p = find_newline(p, sample_end);
   }
+
+  if ( sample_end == end || snps == 0 )
+    return snps;
+
+  const double bytes_per_snp = static_cast<double>(sample_end - s) / snps;
+  return static_cast<size_t>(1.02 * (end - s) / bytes_per_snp);
 }
 
-static inline Genotype parse_genotype(const char*& s)
+/*
+ * Returns a pointer just past the last newline in [s, end), or s if there is
+ * none.
+ */
+static const char* after_last_newline(const char* s, const char* end)
 {
-  Nucleotide first = parse_nucleotide(s);
-  Nucleotide second = parse_nucleotide(s);
-  return Genotype(first, second);
+  for ( const char* p = end; p > s; --p )
+    if ( p[-1] == '\n' )
+      return p;
+
+  return s;
 }
 
-static inline void skipline(const char*& s)
+static FileFormat resolve_format(const ParseOptions& options,
+    const char* data, const size_t size)
 {
-  while ( *s != '\n' ) ++s;
+  if ( options.format != FORMAT_AUTO )
+    return options.format;
+
+  return detect_format(data, size);
 }
 
 /**
- * Reads a 23andMe-formatted genome file.  It currently uses reference human
+ * Reads a genome from memory.  23andMe files currently use reference human
  * assembly build 37 (annotation release 104).
  */
-void parse_file(const std::string& name, Genome& genome)
+void parse_buffer(const char* data, const size_t size, Genome& genome,
+    const ParseOptions& options)
 {
-  CharToNucleotide[static_cast<unsigned>('A')] = A;
-  CharToNucleotide[static_cast<unsigned>('G')] = G;
-  CharToNucleotide[static_cast<unsigned>('C')] = C;
-  CharToNucleotide[static_cast<unsigned>('T')] = T;
-  CharToNucleotide[static_cast<unsigned>('D')] = D;
-  CharToNucleotide[static_cast<unsigned>('I')] = I;
+  const char* s = data;
+  const char* end = data + size;
+  const FileFormat format = resolve_format(options, data, size);
 
-  File fd(name.c_str(), O_RDONLY);
-  MMap fmap(0, filesize(fd), PROT_READ, MAP_PRIVATE, fd, 0);
-  auto s = static_cast<const char*>(fmap.ptr());
+  skip_comments(s, end);
 
-  skip_comments(s);
+  Validating checks(std::count(data, s, '\n'));
+  Validating* validating = options.errors? &checks : NULL;
+
+  // Complete lines are parsed in place. A final, unterminated line is copied
+  // and given a newline, so the tokenizers never need to check for the end
+  // of the buffer.
+  const char* tail = after_last_newline(s, end);
+  const unsigned threads = worker_count(options, tail - s);
   bool ychromo = false;
 
-  // Local cache of SNPs and RSIDs, for more locality and hence more speed. Its
-  // size is somewhat arbitrary, but shouldn't be too big.
-  #define SIZE 200
-  SNP snps[SIZE];
-  RSID rsids[SIZE];
-  int i=0;
+  genome.reserve(genome.size() + estimate_snps(s, end));
 
-  for ( ; *s; ++s ) {
-    // Skip anything other than an RSID (internal IDs, etc.)
-    if ( *s != 'r' ) {
-      skipline(s);
-      continue;
-    }
+  GenomeSink sink(genome);
 
-    RSID& rsid = rsids[i];
-    SNP& snp = snps[i];
+  if ( threads > 1 )
+    ychromo = parse_parallel(format, s, tail, genome, threads, validating);
+  else
+    parse_range(format, s, tail, sink, validating);
 
-    rsid = parse_uint32(s+=2); // skip "rs"-prefix
+  if ( tail < end ) {
+    const std::string line = std::string(tail, end) + '\n';
+    parse_range(format, line.data(), line.data() + line.size(), sink,
+                validating);
+  }
 
-    if ( rsid < genome.first ) genome.first = rsid;
-    if ( rsid > genome.last ) genome.last = rsid;
+  sink.flush();
+  genome.compact();
+  genome.build_filter();
+  genome.y_chromosome = ychromo || sink.ychromo;
 
-    snp.chromosome = parse_chromo(skipwhite(s));
-    snp.position = parse_uint32(skipwhite(s));
-    snp.genotype = parse_genotype(skipwhite(s));
+  if ( validating )
+    options.errors->insert(options.errors->end(), checks.errors.begin(),
+                           checks.errors.end());
+}
 
-    ychromo |= (snp.chromosome==CHR_Y && snp.genotype.first!=NONE);
+/**
+ * Reads a genome from a descriptor, which may be a pipe. The format is
+ * detected from the first chunk.
+ */
+void parse_stream(const int fd, Genome& genome, const ParseOptions& options)
+{
+  // Chunks big enough to give each thread its share
+  unsigned wanted = options.threads;
+  if ( wanted == 0 )
+    wanted = std::max(1u, std::thread::hardware_concurrency());
 
-    // Ordinarly, we would just call `genome.insert(rsid, snp)` here, but it's
-    // a tad faster to stage them in an array first, and then flush it to the
-    // hash map when it's full.
+  LineChunks chunks(fd, wanted * MIN_CHUNK_SIZE);
+  GenomeSink sink(genome);
+  std::vector<char> chunk;
+  FileFormat format = options.format;
+  Validating checks;
+  Validating* validating = options.errors? &checks : NULL;
+  bool ychromo = false;
 
-    if ( ++i == SIZE ) {
-      i = 0;
-      for ( int n = 0; n < SIZE; ++n )
-        genome.insert(rsids[n], snps[n]);
-    }
+  while ( chunks.next(chunk) ) {
+    if ( format == FORMAT_AUTO )
+      format = detect_format(chunk.data(), chunk.size());
+
+    const char* s = chunk.data();
+    const char* end = s + chunk.size();
+    const unsigned threads = worker_count(options, chunk.size());
+
+    if ( threads > 1 ) {
+      // Keeps the SNPs in file order, so the first of any duplicates wins
+      sink.flush();
+      ychromo |= parse_parallel(format, s, end, genome, threads, validating);
+    } else
+      parse_range(format, s, end, sink, validating);
+  }
+
+  sink.flush();
+  genome.compact();
+  genome.build_filter();
+  genome.y_chromosome = ychromo || sink.ychromo;
+
+  if ( options.errors )
+    options.errors->insert(options.errors->end(), checks.errors.begin(),
+                           checks.errors.end());
+}
+
+/*
+ * Returns true if the file can be memory mapped and parsed as-is.
+ */
+static bool is_mappable(const int fd)
+{
+  if ( !is_regular_file(fd) )
+    return false;
+
+  char magic[4];
+  const ssize_t n = pread(fd, magic, sizeof(magic), 0);
+  return n >= 0 && !is_compressed(magic, static_cast<size_t>(n));
+}
+
+static int map_flags(const unsigned advice)
+{
+  int flags = MAP_PRIVATE;
+
+#ifdef MAP_POPULATE
+  if ( advice & ADVISE_POPULATE )
+    flags |= MAP_POPULATE;
+#endif
+
+  return flags;
+}
+
+/*
+ * Passes access hints on to the kernel. Since they're only hints, it's fine
+ * if some aren't supported.
+ */
+static void advise(const MMap& map, const unsigned advice)
+{
+  if ( advice & ADVISE_SEQUENTIAL )
+    map.advise(MADV_SEQUENTIAL);
+
+  if ( advice & ADVISE_WILLNEED )
+    map.advise(MADV_WILLNEED);
+
+#ifdef MADV_HUGEPAGE
+  if ( advice & ADVISE_HUGEPAGES )
+    map.advise(MADV_HUGEPAGE);
+#endif
+}
+
+bool prefetch_file(const std::string& name)
+{
+  const int fd = open(name.c_str(), O_RDONLY);
+
+  if ( fd < 0 )
+    return false;
+
+  // The pages stay in the cache after the descriptor is closed
+#ifdef POSIX_FADV_WILLNEED
+  posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+  close(fd);
+  return true;
+}
+
+/**
+ * Reads a genome file in any of the supported formats. Compressed files and
+ * anything that isn't a regular file are streamed.
+ */
+void parse_file(const std::string& name, Genome& genome,
+    const ParseOptions& options)
+{
+  File fd(name.c_str(), O_RDONLY);
+
+  if ( !is_mappable(fd) ) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    if ( options.advice & ADVISE_SEQUENTIAL )
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    parse_stream(fd, genome, options);
+    return;
   }
 
-  // flush the rest
-  for ( int n=0; n < i; ++n )
-    genome.insert(rsids[n], snps[n]);
+  const size_t size = filesize(fd);
+
+  if ( size == 0 ) {
+    parse_buffer(NULL, 0, genome, options);
+    return;
+  }
 
-  genome.y_chromosome = ychromo;
+  MMap fmap(0, size, PROT_READ, map_flags(options.advice), fd, 0);
+  advise(fmap, options.advice);
+  parse_buffer(static_cast<const char*>(fmap.ptr()), size, genome, options);
 }
@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "dnatraits.hpp"
+#include "parallel.hpp"
+
+const size_t RuleSet::NOT_FOUND;
+
+/*
+ * An RSID and the set of genotype codes it may have, as a bitmask indexed
+ * by PackedSNP::code().
+ */
+struct DLL_LOCAL Predicate {
+  RSID rsid;
+  std::uint32_t probe; // index into probes
+  std::uint32_t codes;
+};
+
+/*
+ * The rules in disjunctive normal form, laid out flat. Each rule is a run
+ * of clauses, which are or'ed together, and each clause a run of
+ * predicates, which are and'ed together. The runs are given by their ends.
+ */
+struct DLL_LOCAL RuleSet::RuleSetImpl {
+  std::vector<std::string> names;
+  std::vector<Predicate> predicates;
+  std::vector<std::uint32_t> clauses;
+  std::vector<std::uint32_t> rules;
+
+  // Distinct RSIDs, sorted
+  std::vector<RSID> probes;
+
+  void add(const std::string& text);
+  void compile();
+  void run(const std::uint8_t* codes, std::uint8_t* out) const;
+  void evaluate(const Genome& genome, SNP* snps, std::uint8_t* codes,
+                std::uint8_t* out) const;
+};
+
+static std::invalid_argument syntax_error(const size_t line,
+    const std::string& reason)
+{
+  std::ostringstream s;
+  s << "Rule syntax error on line " << line << ": " << reason;
+  return std::invalid_argument(s.str());
+}
+
+static bool to_nucleotide(const char c, Nucleotide& n)
+{
+  switch ( std::toupper(static_cast<unsigned char>(c)) ) {
+    case 'A': n = A; return true;
+    case 'C': n = C; return true;
+    case 'G': n = G; return true;
+    case 'T': n = T; return true;
+    case 'D': n = D; return true;
+    case 'I': n = I; return true;
+    default: return false;
+  }
+}
+
+static bool parse_rsid(const std::string& word, RSID& rsid)
+{
+  if ( word.size() < 3 || word.size() > 12 ||
+       std::tolower(static_cast<unsigned char>(word[0])) != 'r' ||
+       std::tolower(static_cast<unsigned char>(word[1])) != 's' )
+    return false;
+
+  std::uint64_t n = 0;
+  for ( size_t i = 2; i < word.size(); ++i ) {
+    if ( !std::isdigit(static_cast<unsigned char>(word[i])) )
+      return false;
+    n = 10*n + (word[i] - '0');
+  }
+
+  if ( n > 0xffffffff )
+    return false;
+
+  rsid = static_cast<RSID>(n);
+  return true;
+}
+
+/*
+ * Turns genotypes such as "AG/GG" or "~CC" into a set of codes.
+ */
+static bool parse_genotypes(const std::string& word, std::uint32_t& codes)
+{
+  const bool complemented = !word.empty() && word[0] == '~';
+  std::istringstream alternatives(word.substr(complemented? 1 : 0));
+  std::string alt;
+
+  codes = 0;
+
+  while ( std::getline(alternatives, alt, '/') ) {
+    Nucleotide first = NONE, second = NONE;
+
+    if ( alt != "--" &&
+         !(alt.size() == 1 && to_nucleotide(alt[0], first)) &&
+         !(alt.size() == 2 && to_nucleotide(alt[0], first) &&
+           to_nucleotide(alt[1], second)) )
+      return false;
+
+    const Genotype g(first, second);
+    codes |= 1u << PackedSNP::code(complemented? ~g : g);
+  }
+
+  return codes != 0 && word[word.size() - 1] != '/';
+}
+
+/*
+ * Splits a line into words, with & and | as words of their own.
+ */
+static std::vector<std::string> tokenize(const std::string& line)
+{
+  std::vector<std::string> words;
+  std::string word;
+
+  for ( const char c : line ) {
+    if ( c == '#' )
+      break;
+
+    if ( std::isspace(static_cast<unsigned char>(c)) || c == '&' || c == '|' ) {
+      if ( !word.empty() )
+        words.push_back(word);
+      word.clear();
+      if ( c == '&' || c == '|' )
+        words.push_back(std::string(1, c));
+    } else
+      word += c;
+  }
+
+  if ( !word.empty() )
+    words.push_back(word);
+
+  return words;
+}
+
+void RuleSet::RuleSetImpl::add(const std::string& text)
+{
+  enum { RSID_NEXT, GENOTYPE_NEXT, OPERATOR_NEXT } expect = RSID_NEXT;
+
+  // Parse into copies, so a syntax error leaves the rules as they were
+  auto names_ = names;
+  auto predicates_ = predicates;
+  auto clauses_ = clauses;
+  auto rules_ = rules;
+  bool open = false;
+
+  auto close = [&](const size_t line) {
+    if ( open && expect != OPERATOR_NEXT )
+      throw syntax_error(line, "Incomplete rule " + names_.back());
+    if ( open ) {
+      clauses_.push_back(predicates_.size());
+      rules_.push_back(clauses_.size());
+    }
+  };
+
+  std::istringstream lines(text);
+  std::string line;
+  size_t lineno = 0;
+
+  while ( std::getline(lines, line) ) {
+    const auto words = tokenize(line);
+    ++lineno;
+
+    for ( size_t n = 0; n < words.size(); ++n ) {
+      const std::string& word = words[n];
+
+      if ( n == 0 && word[word.size() - 1] == ':' ) {
+        const std::string name = word.substr(0, word.size() - 1);
+        close(lineno - 1);
+
+        if ( name.empty() )
+          throw syntax_error(lineno, "Missing rule name");
+        if ( std::find(names_.begin(), names_.end(), name) != names_.end() )
+          throw syntax_error(lineno, "Rule " + name + " given twice");
+
+        names_.push_back(name);
+        expect = RSID_NEXT;
+        open = true;
+        continue;
+      }
+
+      if ( !open )
+        throw syntax_error(lineno, "Expected a rule name, got " + word);
+
+      switch ( expect ) {
+        case RSID_NEXT: {
+          Predicate p;
+          if ( !parse_rsid(word, p.rsid) )
+            throw syntax_error(lineno, "Expected an RSID, got " + word);
+          p.probe = 0;
+          p.codes = 0;
+          predicates_.push_back(p);
+          expect = GENOTYPE_NEXT;
+          break;
+        }
+
+        case GENOTYPE_NEXT:
+          if ( !parse_genotypes(word, predicates_.back().codes) )
+            throw syntax_error(lineno, "Expected a genotype, got " + word);
+          expect = OPERATOR_NEXT;
+          break;
+
+        case OPERATOR_NEXT:
+          if ( word == "|" )
+            clauses_.push_back(predicates_.size());
+          else if ( word != "&" )
+            throw syntax_error(lineno, "Expected & or |, got " + word);
+          expect = RSID_NEXT;
+          break;
+      }
+    }
+  }
+
+  close(lineno);
+
+  names.swap(names_);
+  predicates.swap(predicates_);
+  clauses.swap(clauses_);
+  rules.swap(rules_);
+  compile();
+}
+
+/*
+ * Points the predicates at the distinct RSIDs.
+ */
+void RuleSet::RuleSetImpl::compile()
+{
+  probes.clear();
+  probes.reserve(predicates.size());
+  for ( const auto& p : predicates )
+    probes.push_back(p.rsid);
+
+  std::sort(probes.begin(), probes.end());
+  probes.erase(std::unique(probes.begin(), probes.end()), probes.end());
+
+  for ( auto& p : predicates )
+    p.probe = std::lower_bound(probes.begin(), probes.end(), p.rsid) -
+              probes.begin();
+}
+
+/*
+ * Evaluates the rules, given the genotype code of each probe. There are no
+ * branches on the genotypes, only loops over the runs.
+ */
+void RuleSet::RuleSetImpl::run(const std::uint8_t* codes,
+    std::uint8_t* out) const
+{
+  const Predicate* p = predicates.data();
+  size_t clause = 0;
+
+  for ( size_t r = 0; r < rules.size(); ++r ) {
+    std::uint32_t any = 0;
+
+    for ( ; clause < rules[r]; ++clause ) {
+      const Predicate* end = predicates.data() + clauses[clause];
+      std::uint32_t all = 1;
+
+      for ( ; p < end; ++p )
+        all &= p->codes >> codes[p->probe];
+
+      any |= all;
+    }
+
+    out[r] = any & 1;
+  }
+}
+
+void RuleSet::RuleSetImpl::evaluate(const Genome& genome, SNP* snps,
+    std::uint8_t* codes, std::uint8_t* out) const
+{
+  // Missing SNPs come back as NONE_SNP, which is a no-call
+  genome.lookup(probes.data(), probes.size(), snps);
+
+  for ( size_t n = 0; n < probes.size(); ++n )
+    codes[n] = PackedSNP::code(snps[n].genotype);
+
+  run(codes, out);
+}
+
+RuleSet::RuleSet() :
+  pimpl(new RuleSetImpl())
+{
+}
+
+RuleSet::RuleSet(const std::string& text) :
+  pimpl(new RuleSetImpl())
+{
+  pimpl->add(text);
+}
+
+RuleSet::RuleSet(const RuleSet& r) :
+  pimpl(new RuleSetImpl(*r.pimpl))
+{
+}
+
+RuleSet& RuleSet::operator=(const RuleSet& r)
+{
+  if ( this != &r )
+    *pimpl = *r.pimpl;
+  return *this;
+}
+
+RuleSet::~RuleSet()
+{
+  delete pimpl;
+}
+
+void RuleSet::add(const std::string& text)
+{
+  pimpl->add(text);
+}
+
+void RuleSet::load(const std::string& filename)
+{
+  std::ifstream f(filename.c_str());
+  if ( !f )
+    throw std::runtime_error("Could not open " + filename);
+
+  std::ostringstream text;
+  text << f.rdbuf();
+  pimpl->add(text.str());
+}
+
+size_t RuleSet::size() const
+{
+  return pimpl->names.size();
+}
+
+const std::string& RuleSet::name(const size_t rule) const
+{
+  return pimpl->names[rule];
+}
+
+size_t RuleSet::find(const std::string& name) const
+{
+  const auto& names = pimpl->names;
+  const auto it = std::find(names.begin(), names.end(), name);
+  return it != names.end()? it - names.begin() : NOT_FOUND;
+}
+
+std::vector<RSID> RuleSet::rsids() const
+{
+  return pimpl->probes;
+}
+
+std::vector<std::uint8_t> RuleSet::evaluate(const Genome& genome) const
+{
+  std::vector<SNP> snps(pimpl->probes.size());
+  std::vector<std::uint8_t> codes(pimpl->probes.size());
+  std::vector<std::uint8_t> out(size());
+
+  pimpl->evaluate(genome, snps.data(), codes.data(), out.data());
+  return out;
+}
+
+std::vector<std::uint8_t> RuleSet::evaluate(
+    const std::vector<const Genome*>& genomes,
+    const unsigned threads) const
+{
+  const RuleSetImpl& r = *pimpl;
+  std::vector<std::uint8_t> out(genomes.size() * size());
+
+  parallel_for(genomes.size(), threads, [&](size_t begin, size_t end) {
+    std::vector<SNP> snps(r.probes.size());
+    std::vector<std::uint8_t> codes(r.probes.size());
+
+    for ( size_t n = begin; n < end; ++n )
+      r.evaluate(*genomes[n], snps.data(), codes.data(),
+                 &out[n * r.names.size()]);
+  });
+
+  return out;
+}
+
+std::vector<std::uint8_t> RuleSet::evaluate(const Cohort& cohort,
+    const unsigned threads) const
+{
+  const RuleSetImpl& r = *pimpl;
+  std::vector<std::uint8_t> out(cohort.size() * size());
+
+  std::vector<size_t> markers(r.probes.size());
+  for ( size_t n = 0; n < r.probes.size(); ++n )
+    markers[n] = cohort.marker(r.probes[n]);
+
+  const std::uint8_t no_call = PackedSNP::code(NN);
+
+  parallel_for(cohort.size(), threads, [&](size_t begin, size_t end) {
+    std::vector<std::uint8_t> codes(r.probes.size());
+
+    for ( size_t s = begin; s < end; ++s ) {
+      for ( size_t n = 0; n < markers.size(); ++n )
+        codes[n] = markers[n] == Cohort::NOT_FOUND? no_call :
+                   PackedSNP::code(cohort.genotype(s, markers[n]));
+
+      r.run(codes.data(), &out[s * r.names.size()]);
+    }
+  });
+
+  return out;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include "scan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#endif
+
+typedef const char* (*FindByte)(const char*, const char*);
+
+static const char* find_newline_scalar(const char* s, const char* end)
+{
+  while ( s < end && *s != '\n' ) ++s;
+  return s;
+}
+
+static const char* find_field_end_scalar(const char* s, const char* end)
+{
+  while ( s < end && *s != '\t' && *s != '\n' ) ++s;
+  return s;
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+static const char* find_newline_sse2(const char* s, const char* end)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+
+  for ( ; end - s >= 16; s += 16 ) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+
+    if ( mask )
+      return s + __builtin_ctz(mask);
+  }
+
+  return find_newline_scalar(s, end);
+}
+
+__attribute__((target("avx2")))
+static const char* find_newline_avx2(const char* s, const char* end)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+
+  for ( ; end - s >= 32; s += 32 ) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+    const unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+
+    if ( mask )
+      return s + __builtin_ctz(mask);
+  }
+
+  return find_newline_sse2(s, end);
+}
+
+__attribute__((target("sse2")))
+static const char* find_field_end_sse2(const char* s, const char* end)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i tab = _mm_set1_epi8('\t');
+
+  for ( ; end - s >= 16; s += 16 ) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, nl),
+                                                    _mm_cmpeq_epi8(v, tab)));
+
+    if ( mask )
+      return s + __builtin_ctz(mask);
+  }
+
+  return find_field_end_scalar(s, end);
+}
+
+__attribute__((target("avx2")))
+static const char* find_field_end_avx2(const char* s, const char* end)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+  const __m256i tab = _mm256_set1_epi8('\t');
+
+  for ( ; end - s >= 32; s += 32 ) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+    const unsigned mask = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, tab)));
+
+    if ( mask )
+      return s + __builtin_ctz(mask);
+  }
+
+  return find_field_end_sse2(s, end);
+}
+#endif
+
+/*
+ * The kernels for the CPU we're running on, picked once at load time.
+ */
+struct Kernels {
+  FindByte newline;
+  FindByte field_end;
+};
+
+static Kernels select_kernels()
+{
+#ifdef HAVE_X86_KERNELS
+  __builtin_cpu_init();
+
+  if ( __builtin_cpu_supports("avx2") )
+    return Kernels{find_newline_avx2, find_field_end_avx2};
+
+  if ( __builtin_cpu_supports("sse2") )
+    return Kernels{find_newline_sse2, find_field_end_sse2};
+#endif
+
+  return Kernels{find_newline_scalar, find_field_end_scalar};
+}
+
+static const Kernels kernels = select_kernels();
+
+const char* find_newline(const char* s, const char* end)
+{
+  return kernels.newline(s, end);
+}
+
+const char* find_field_end(const char* s, const char* end)
+{
+  return kernels.field_end(s, end);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_SCAN_H
+#define DNA_SCAN_H
+
+#include <cstdint>
+#include <cstring>
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * Returns a pointer to the first newline in [s, end), or end if there is
+ * none. Scans 32 or 16 bytes at a time using AVX2 or SSE2, depending on what
+ * the CPU supports.
+ */
+DLL_LOCAL const char* find_newline(const char* s, const char* end);
+
+/*
+ * Returns a pointer to the first tab or newline in [s, end), or end if there
+ * is none. Used to step over long fields, such as the INFO column of VCF
+ * files, with the same kernels as find_newline.
+ */
+DLL_LOCAL const char* find_field_end(const char* s, const char* end);
+
+/*
+ * Parses the leading decimal digits of the eight bytes at s, all in one go,
+ * and advances s past them. All eight bytes must be readable. The count of
+ * digits is returned in len; if it's eight, there may be more to come.
+ */
+static inline uint32_t parse_digits8(const char*& s, unsigned& len)
+{
+  uint64_t v;
+  std::memcpy(&v, s, sizeof(v));
+
+  // Any byte that isn't 0x30-0x39 becomes non-zero. Carries only propagate
+  // upwards, i.e. past the first non-digit, so they don't matter.
+  const uint64_t hi = 0xF0F0F0F0F0F0F0F0ULL;
+  const uint64_t zeros = 0x3030303030303030ULL;
+  const uint64_t nondigit = ((v & hi) ^ zeros) |
+                            (((v + 0x0606060606060606ULL) & hi) ^ zeros);
+
+  len = nondigit? __builtin_ctzll(nondigit) / 8 : 8;
+
+  if ( len == 0 )
+    return 0;
+
+  s += len;
+
+  // Shift digits up so that the missing ones become leading zeros, then
+  // combine pairs, quads and octets.
+  v = (v - zeros) << (8*(8 - len));
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +
+       (((v >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32;
+
+  return static_cast<uint32_t>(v);
+}
+
+#endif
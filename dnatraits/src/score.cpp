@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "format.hpp"
+#include "parallel.hpp"
+#include "score.hpp"
+
+/*
+ * Whether each allele of the genotype is one of the two.
+ */
+static bool made_of(const Genotype& g, const Nucleotide a, const Nucleotide b)
+{
+  return (g.first == a || g.first == b) &&
+         (g.second == NONE || g.second == a || g.second == b);
+}
+
+static unsigned copies(const Genotype& g, const Nucleotide n)
+{
+  return (g.first == n) + (g.second == n);
+}
+
+/*
+ * Copies of the effect allele in the genotype, after working out its
+ * strand if the other allele is known.
+ */
+static unsigned dosage(const Genotype& g, const Nucleotide effect,
+    const Nucleotide other)
+{
+  if ( g.first == NONE )
+    return NO_DOSAGE;
+
+  if ( other == NONE )
+    return copies(g, effect);
+
+  if ( made_of(g, effect, other) )
+    return copies(g, effect);
+
+  if ( made_of(g, complement(effect), complement(other)) )
+    return copies(g, complement(effect));
+
+  return NO_DOSAGE;
+}
+
+/*
+ * The dosages of all genotype codes.
+ */
+static std::uint64_t dosages(const Nucleotide effect, const Nucleotide other)
+{
+  std::uint64_t bits = ~static_cast<std::uint64_t>(0);
+
+  for ( unsigned code = 1; code < 32; ++code ) {
+    PackedSNP p;
+    p.bits = code;
+    if ( PackedSNP::code(p.genotype()) != code )
+      continue;
+
+    const std::uint64_t d = dosage(p.genotype(), effect, other);
+    bits &= ~(static_cast<std::uint64_t>(3) << (2*code));
+    bits |= d << (2*code);
+  }
+
+  return bits;
+}
+
+ScoreSum PolygenicScore::ScoreImpl::score(const Genome& genome, SNP* snps,
+    std::uint8_t* codes) const
+{
+  double sum = 0;
+  std::uint32_t variants = 0;
+
+  for ( size_t at = 0; at < rsids.size(); at += BLOCK ) {
+    const size_t count = std::min(BLOCK, rsids.size() - at);
+
+    // Missing SNPs come back as NONE_SNP, which has no dosage
+    genome.lookup(&rsids[at], count, snps);
+
+    for ( size_t n = 0; n < count; ++n )
+      codes[n] = PackedSNP::code(snps[n].genotype);
+
+    // No branches, so this vectorizes
+    for ( size_t n = 0; n < count; ++n ) {
+      const unsigned d = dosage(at + n, codes[n]);
+      const bool counts = d != NO_DOSAGE;
+      sum += counts? weights[at + n]*d : 0.0;
+      variants += counts;
+    }
+  }
+
+  ScoreSum r;
+  r.sum = sum;
+  r.variants = variants;
+  return r;
+}
+
+static bool parse_allele(const std::string& s, Nucleotide& n)
+{
+  n = s.size() == 1? CharToNucleotide[static_cast<unsigned char>(s[0])] :
+                     NONE;
+  return n != NONE;
+}
+
+static std::invalid_argument weights_error(const std::string& filename,
+    const size_t line, const std::string& reason)
+{
+  std::ostringstream s;
+  s << filename << ":" << line << ": " << reason;
+  return std::invalid_argument(s.str());
+}
+
+PolygenicScore::PolygenicScore() :
+  pimpl(new ScoreImpl())
+{
+}
+
+PolygenicScore::PolygenicScore(const PolygenicScore& p) :
+  pimpl(new ScoreImpl(*p.pimpl))
+{
+}
+
+PolygenicScore& PolygenicScore::operator=(const PolygenicScore& p)
+{
+  if ( this != &p )
+    *pimpl = *p.pimpl;
+  return *this;
+}
+
+PolygenicScore::~PolygenicScore()
+{
+  delete pimpl;
+}
+
+void PolygenicScore::add(const RSID& rsid, const Nucleotide effect,
+    const double weight, const Nucleotide other)
+{
+  pimpl->rsids.push_back(rsid);
+  pimpl->weights.push_back(weight);
+  pimpl->dosages.push_back(dosages(effect, other));
+}
+
+size_t PolygenicScore::load(const std::string& filename)
+{
+  std::ifstream f(filename.c_str());
+  if ( !f )
+    throw std::runtime_error("Could not open " + filename);
+
+  // Added to a copy, so a bad file leaves the model as it was
+  PolygenicScore model(*this);
+  size_t skipped = 0;
+  size_t lineno = 0;
+  bool first = true;
+  std::string line;
+
+  while ( std::getline(f, line) ) {
+    ++lineno;
+
+    const size_t comment = line.find('#');
+    if ( comment != std::string::npos )
+      line.erase(comment);
+
+    std::istringstream fields(line);
+    std::string id, effect, weight, other;
+    if ( !(fields >> id) )
+      continue;
+
+    const char* digits = id.c_str() + std::min<size_t>(2, id.size());
+    char* end = NULL;
+    const unsigned long rsid = std::strtoul(digits, &end, 10);
+    const bool valid = id.size() > 2 &&
+      std::tolower(static_cast<unsigned char>(id[0])) == 'r' &&
+      std::tolower(static_cast<unsigned char>(id[1])) == 's' &&
+      std::isdigit(static_cast<unsigned char>(*digits)) &&
+      *end == '\0' && rsid <= 0xffffffffUL;
+
+    const bool header = first && !valid;
+    first = false;
+
+    if ( header )
+      continue;
+
+    if ( !valid )
+      throw weights_error(filename, lineno, "Invalid RSID " + id);
+
+    if ( !(fields >> effect >> weight) )
+      throw weights_error(filename, lineno, "Expected rsid, allele, weight");
+    fields >> other;
+
+    const double w = std::strtod(weight.c_str(), &end);
+    if ( end == weight.c_str() || *end != '\0' )
+      throw weights_error(filename, lineno, "Invalid weight " + weight);
+
+    Nucleotide e, o = NONE;
+    if ( !parse_allele(effect, e) ||
+         (!other.empty() && !parse_allele(other, o)) ) {
+      ++skipped;
+      continue;
+    }
+
+    model.add(static_cast<RSID>(rsid), e, w, o);
+  }
+
+  std::swap(pimpl, model.pimpl);
+  return skipped;
+}
+
+size_t PolygenicScore::size() const
+{
+  return pimpl->rsids.size();
+}
+
+std::vector<RSID> PolygenicScore::rsids() const
+{
+  return pimpl->rsids;
+}
+
+ScoreSum PolygenicScore::score(const Genome& genome) const
+{
+  SNP snps[BLOCK];
+  std::uint8_t codes[BLOCK];
+  return pimpl->score(genome, snps, codes);
+}
+
+std::vector<ScoreSum> PolygenicScore::score(
+    const std::vector<const Genome*>& genomes,
+    const unsigned threads) const
+{
+  std::vector<ScoreSum> out(genomes.size());
+
+  parallel_for(genomes.size(), threads, [&](size_t begin, size_t end) {
+    std::vector<SNP> snps(BLOCK);
+    std::vector<std::uint8_t> codes(BLOCK);
+
+    for ( size_t n = begin; n < end; ++n )
+      out[n] = pimpl->score(*genomes[n], snps.data(), codes.data());
+  });
+
+  return out;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_SCORE_H
+#define DNA_SCORE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "dnatraits.hpp"
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * Variants are looked up this many at a time, so the buffers stay small.
+ */
+static const size_t BLOCK = 1024;
+
+/*
+ * Dosage of a variant that doesn't count, such as a no-call.
+ */
+static const unsigned NO_DOSAGE = 3;
+
+/*
+ * The variants of a polygenic score as parallel arrays. Each variant's
+ * dosages are two bits per genotype code, by PackedSNP::code(): the
+ * number of effect alleles, or NO_DOSAGE.
+ */
+struct DLL_LOCAL PolygenicScore::ScoreImpl {
+  std::vector<RSID> rsids;
+  std::vector<double> weights;
+  std::vector<std::uint64_t> dosages;
+
+  inline unsigned dosage(const size_t variant, const unsigned code) const {
+    return (dosages[variant] >> (2*code)) & 3;
+  }
+
+  /*
+   * Scores a genome, using the buffers for BLOCK SNPs and codes.
+   */
+  ScoreSum score(const Genome& genome, SNP* snps, std::uint8_t* codes) const;
+};
+
+#endif
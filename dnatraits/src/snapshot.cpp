@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "file.hpp"
+#include "filesize.hpp"
+#include "snapshot.hpp"
+
+static const char MAGIC[8] = {'D', 'N', 'A', 'T', 'R', 'A', 'I', 'T'};
+static const std::uint32_t VERSION = 2;
+static const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+static inline std::uint64_t align8(const std::uint64_t n)
+{
+  return (n + 7) & ~static_cast<std::uint64_t>(7);
+}
+
+/*
+ * FNV-1a, taken a word at a time to keep up with the disk.
+ */
+static std::uint64_t checksum(const char* p, size_t n)
+{
+  std::uint64_t h = 0xcbf29ce484222325ULL;
+
+  for ( ; n >= 8; p += 8, n -= 8 ) {
+    std::uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    h = (h ^ w) * 0x100000001b3ULL;
+    h ^= h >> 32;
+  }
+
+  for ( ; n > 0; --n )
+    h = (h ^ static_cast<unsigned char>(*p++)) * 0x100000001b3ULL;
+
+  return h;
+}
+
+static std::uint64_t header_checksum(const SnapshotHeader& h)
+{
+  return checksum(reinterpret_cast<const char*>(&h),
+                  offsetof(SnapshotHeader, header_checksum));
+}
+
+static inline bool in_bounds(const std::uint64_t offset,
+    const std::uint64_t bytes, const std::uint64_t size)
+{
+  return offset >= sizeof(SnapshotHeader) && offset <= size &&
+         bytes <= size - offset;
+}
+
+const SNP* SortedSNPs::find(const RSID& id) const
+{
+  const RSID* end = ids + count;
+  const RSID* p = std::lower_bound(ids, end, id);
+  return (p != end && *p == id)? &snps[p - ids] : NULL;
+}
+
+void SortedSNPs::find(const RSID* wanted, const size_t n,
+    const SNP** out) const
+{
+  const size_t GROUP = 16;
+  const RSID* lo[GROUP];
+
+  for ( size_t at = 0; at < n; at += GROUP ) {
+    const size_t group = std::min(GROUP, n - at);
+    const RSID* want = wanted + at;
+
+    if ( count == 0 ) {
+      for ( size_t i = 0; i < group; ++i )
+        out[at + i] = NULL;
+      continue;
+    }
+
+    for ( size_t i = 0; i < group; ++i )
+      lo[i] = ids;
+
+    // The last ID at or before each wanted one
+    for ( size_t len = count; len > 1; ) {
+      const size_t half = len / 2;
+      len -= half;
+
+      for ( size_t i = 0; i < group; ++i ) {
+        lo[i] = (lo[i][half] <= want[i])? lo[i] + half : lo[i];
+        __builtin_prefetch(lo[i] + len / 2);
+      }
+    }
+
+    for ( size_t i = 0; i < group; ++i )
+      out[at + i] = *lo[i] == want[i]? &snps[lo[i] - ids] : NULL;
+  }
+}
+
+/*
+ * Lays out a snapshot, returning the header and everything after it.
+ */
+static SnapshotHeader encode(const Genome& genome,
+                             const SortedSNPs& rsids,
+                             const SortedSNPs& internal,
+                             std::vector<char>& payload)
+{
+  SnapshotHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.byte_order = BYTE_ORDER_MARK;
+  h.snp_size = sizeof(SNP);
+  h.y_chromosome = genome.y_chromosome;
+  h.first = genome.first;
+  h.last = genome.last;
+  h.count = rsids.count;
+  h.rsids_offset = align8(sizeof(SnapshotHeader));
+  h.snps_offset = align8(h.rsids_offset + rsids.count*sizeof(RSID));
+  h.internal_count = internal.count;
+  h.internal_ids_offset = align8(h.snps_offset + rsids.count*sizeof(SNP));
+  h.internal_snps_offset = align8(h.internal_ids_offset +
+                                  internal.count*sizeof(RSID));
+  h.file_size = h.internal_snps_offset + internal.count*sizeof(SNP);
+
+  payload.assign(h.file_size - sizeof(SnapshotHeader), 0);
+  char* base = payload.data() - sizeof(SnapshotHeader);
+  std::memcpy(base + h.rsids_offset, rsids.ids, rsids.count*sizeof(RSID));
+  std::memcpy(base + h.snps_offset, rsids.snps, rsids.count*sizeof(SNP));
+  std::memcpy(base + h.internal_ids_offset, internal.ids,
+              internal.count*sizeof(RSID));
+  std::memcpy(base + h.internal_snps_offset, internal.snps,
+              internal.count*sizeof(SNP));
+
+  h.checksum = checksum(payload.data(), payload.size());
+  h.header_checksum = header_checksum(h);
+  return h;
+}
+
+static bool write_at(const int fd, const void* data, size_t size,
+                     off_t offset)
+{
+  auto p = static_cast<const char*>(data);
+
+  while ( size > 0 ) {
+    const ssize_t n = pwrite(fd, p, size, offset);
+    if ( n < 0 && errno == EINTR )
+      continue;
+    if ( n <= 0 )
+      return false;
+    p += n;
+    size -= n;
+    offset += n;
+  }
+
+  return true;
+}
+
+/*
+ * Closes a file or shared memory descriptor when it goes out of scope.
+ */
+struct DLL_LOCAL SharedFd {
+  const int fd;
+
+  explicit SharedFd(const int fd_) : fd(fd_) {
+  }
+
+  ~SharedFd() {
+    if ( fd >= 0 )
+      close(fd);
+  }
+};
+
+/*
+ * Creates a new file next to filename, with a name nobody else uses. It's
+ * created with mode 0666, so the umask applies as for any other new file.
+ */
+static int create_temp(const std::string& filename, std::string& temp)
+{
+  static std::atomic<unsigned> counter(0);
+
+  for ( int tries = 0; tries < 100; ++tries ) {
+    temp = filename + "." + std::to_string(getpid()) + "." +
+           std::to_string(counter++);
+
+    const int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if ( fd >= 0 || errno != EEXIST )
+      return fd;
+  }
+
+  return -1;
+}
+
+/*
+ * Flushes the directory entry of a renamed file to disk. Some file systems
+ * can't sync directories, and say so with EINVAL.
+ */
+static bool sync_directory(const std::string& filename)
+{
+  const size_t slash = filename.rfind('/');
+  const std::string dir = slash == std::string::npos? "." :
+                          slash == 0? "/" : filename.substr(0, slash);
+
+  SharedFd fd(open(dir.c_str(), O_RDONLY | O_DIRECTORY));
+  return fd.fd >= 0 && (fsync(fd.fd) == 0 || errno == EINVAL);
+}
+
+void Snapshot::write(const std::string& filename,
+                     const Genome& genome,
+                     const SortedSNPs& rsids,
+                     const SortedSNPs& internal)
+{
+  std::vector<char> payload;
+  const SnapshotHeader h = encode(genome, rsids, internal, payload);
+
+  // Loaded snapshots map the file in place, so it's never rewritten. A new
+  // one is written next to it, and renamed over it once complete.
+  std::string temp;
+  bool ok = false;
+  {
+    SharedFd fd(create_temp(filename, temp));
+    if ( fd.fd < 0 )
+      throw std::runtime_error("Could not write " + filename);
+
+    ok = write_at(fd.fd, &h, sizeof(h), 0) &&
+         write_at(fd.fd, payload.data(), payload.size(), sizeof(h)) &&
+         fsync(fd.fd) == 0;
+  }
+
+  if ( !ok || rename(temp.c_str(), filename.c_str()) != 0 ) {
+    unlink(temp.c_str());
+    throw std::runtime_error("Could not write " + filename);
+  }
+
+  if ( !sync_directory(filename) )
+    throw std::runtime_error("Could not sync the directory of " + filename);
+}
+
+void Snapshot::publish(const std::string& name,
+                       const Genome& genome,
+                       const SortedSNPs& rsids,
+                       const SortedSNPs& internal)
+{
+  std::vector<char> payload;
+  const SnapshotHeader h = encode(genome, rsids, internal, payload);
+
+  // A fresh object, so nobody sees a half written one. It's read-only for
+  // everyone else.
+  shm_unlink(name.c_str());
+  SharedFd fd(shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0444));
+
+  if ( fd.fd < 0 )
+    throw std::runtime_error("Could not create shared memory " + name);
+
+  // The header goes last, so the object isn't valid until it's complete
+  if ( ftruncate(fd.fd, h.file_size) != 0 ||
+       !write_at(fd.fd, payload.data(), payload.size(), sizeof(h)) ||
+       !write_at(fd.fd, &h, sizeof(h), 0) )
+  {
+    shm_unlink(name.c_str());
+    throw std::runtime_error("Could not write shared memory " + name);
+  }
+}
+
+Snapshot* Snapshot::attach(const std::string& name, const bool verify)
+{
+  SharedFd fd(shm_open(name.c_str(), O_RDONLY, 0));
+
+  if ( fd.fd < 0 )
+    throw std::runtime_error("Could not open shared memory " + name);
+
+  std::unique_ptr<Snapshot> s(new Snapshot());
+  s->map_fd(fd.fd, name, verify);
+  return s.release();
+}
+
+Snapshot::Snapshot() :
+  map(),
+  header(NULL),
+  rsids_(),
+  internal_()
+{
+}
+
+Snapshot::Snapshot(const std::string& filename, const bool verify) :
+  map(),
+  header(NULL),
+  rsids_(),
+  internal_()
+{
+  File fd(filename.c_str(), O_RDONLY);
+  map_fd(fd, filename, verify);
+}
+
+void Snapshot::map_fd(const int fd, const std::string& filename,
+                      const bool verify)
+{
+  const size_t size = filesize(fd);
+
+  if ( size < sizeof(SnapshotHeader) )
+    throw std::runtime_error("Not a genome snapshot: " + filename);
+
+  map.reset(new MMap(0, size, PROT_READ, MAP_SHARED, fd, 0));
+
+  auto base = static_cast<const char*>(map->ptr());
+  header = reinterpret_cast<const SnapshotHeader*>(base);
+
+  if ( std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 )
+    throw std::runtime_error("Not a genome snapshot: " + filename);
+
+  if ( header->version != VERSION ||
+       header->byte_order != BYTE_ORDER_MARK ||
+       header->snp_size != sizeof(SNP) )
+    throw std::runtime_error("Incompatible genome snapshot: " + filename);
+
+  const std::uint64_t count = header->count;
+  const std::uint64_t internal = header->internal_count;
+
+  if ( header->header_checksum != header_checksum(*header) ||
+       header->file_size != size ||
+       count > size || internal > size ||
+       !in_bounds(header->rsids_offset, count*sizeof(RSID), size) ||
+       !in_bounds(header->snps_offset, count*sizeof(SNP), size) ||
+       !in_bounds(header->internal_ids_offset, internal*sizeof(RSID), size) ||
+       !in_bounds(header->internal_snps_offset, internal*sizeof(SNP), size) ||
+       header->rsids_offset % sizeof(RSID) != 0 ||
+       header->internal_ids_offset % sizeof(RSID) != 0 )
+    throw std::runtime_error("Corrupt genome snapshot: " + filename);
+
+  if ( verify && header->checksum != checksum(base + sizeof(SnapshotHeader),
+                                              size - sizeof(SnapshotHeader)) )
+    throw std::runtime_error("Checksum mismatch in genome snapshot: " +
+                             filename);
+
+  rsids_ = SortedSNPs(
+      reinterpret_cast<const RSID*>(base + header->rsids_offset),
+      reinterpret_cast<const SNP*>(base + header->snps_offset),
+      static_cast<size_t>(count));
+
+  internal_ = SortedSNPs(
+      reinterpret_cast<const RSID*>(base + header->internal_ids_offset),
+      reinterpret_cast<const SNP*>(base + header->internal_snps_offset),
+      static_cast<size_t>(internal));
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_SNAPSHOT_H
+#define DNA_SNAPSHOT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "dnatraits.hpp"
+#include "mmap.hpp"
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * A sorted array of IDs and the SNPs in the same order.
+ */
+struct DLL_LOCAL SortedSNPs {
+  const RSID* ids;
+  const SNP* snps;
+  size_t count;
+
+  SortedSNPs(const RSID* ids_ = NULL, const SNP* snps_ = NULL,
+             const size_t count_ = 0) :
+    ids(ids_),
+    snps(snps_),
+    count(count_)
+  {
+  }
+
+  /*
+   * Returns the SNP with the given ID, or NULL if there is none.
+   */
+  const SNP* find(const RSID& id) const;
+
+  /*
+   * Sets out[n] to the SNP of ids[n], or NULL. The binary searches are run
+   * in lockstep, a group at a time, with each step's probes prefetched, so
+   * that their cache misses overlap.
+   */
+  void find(const RSID* ids, const size_t count, const SNP** out) const;
+};
+
+/*
+ * On-disk layout of a genome snapshot. The file is the header, followed by
+ * the sorted RSIDs and then the SNPs in the same order, and finally the
+ * same for 23andMe's internal IDs. Everything is in native layout so it can
+ * be used straight from the mapping.
+ *
+ * Bump the version on any change to the layout or to the SNP struct.
+ */
+struct DLL_LOCAL SnapshotHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint32_t snp_size;
+  std::uint32_t y_chromosome;
+  RSID first;
+  RSID last;
+  std::uint64_t count;
+  std::uint64_t rsids_offset;
+  std::uint64_t snps_offset;
+  std::uint64_t internal_count;
+  std::uint64_t internal_ids_offset;
+  std::uint64_t internal_snps_offset;
+  std::uint64_t file_size;
+  std::uint64_t checksum; // of everything after the header
+  std::uint64_t header_checksum; // of the fields above
+};
+
+/*
+ * A read-only, memory mapped genome snapshot.
+ */
+class DLL_LOCAL Snapshot {
+  std::unique_ptr<MMap> map;
+  const SnapshotHeader* header;
+  SortedSNPs rsids_;
+  SortedSNPs internal_;
+
+  Snapshot();
+  void map_fd(const int fd, const std::string& name, const bool verify);
+
+public:
+  /*
+   * Maps the snapshot in the given file. If verify is set, the payload
+   * checksum is checked as well; otherwise only the header is.
+   */
+  Snapshot(const std::string& filename, const bool verify);
+
+  /*
+   * Writes a snapshot of the given RSIDs and internal IDs, which must both
+   * be sorted, and their SNPs.
+   */
+  static void write(const std::string& filename,
+                    const Genome& genome,
+                    const SortedSNPs& rsids,
+                    const SortedSNPs& internal);
+
+  /*
+   * Like write(), but into a new POSIX shared memory object with the given
+   * name, replacing any old one. Processes that have the old one mapped
+   * keep it until they let go.
+   */
+  static void publish(const std::string& name,
+                      const Genome& genome,
+                      const SortedSNPs& rsids,
+                      const SortedSNPs& internal);
+
+  /*
+   * Maps a snapshot published under the given name, read-only.
+   */
+  static Snapshot* attach(const std::string& name, const bool verify);
+
+  inline const SortedSNPs& rsids() const {
+    return rsids_;
+  }
+
+  inline const SortedSNPs& internal() const {
+    return internal_;
+  }
+
+  inline RSID first() const {
+    return header->first;
+  }
+
+  inline RSID last() const {
+    return header->last;
+  }
+
+  inline bool y_chromosome() const {
+    return header->y_chromosome != 0;
+  }
+};
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "stream.hpp"
+
+static const size_t INPUT_SIZE = 1 << 16;
+
+bool is_compressed(const char* magic, const size_t size)
+{
+  auto p = reinterpret_cast<const unsigned char*>(magic);
+
+  if ( size >= 2 && p[0] == 0x1f && p[1] == 0x8b )
+    return true; // gzip
+
+  if ( size >= 4 && p[0] == 'P' && p[1] == 'K' && p[2] == 3 && p[3] == 4 )
+    return true; // zip
+
+  return false;
+}
+
+static size_t read_fd(const int fd, char* buffer, const size_t size)
+{
+  for ( ;; ) {
+    const ssize_t n = read(fd, buffer, size);
+
+    if ( n >= 0 )
+      return static_cast<size_t>(n);
+
+    if ( errno != EINTR )
+      throw std::runtime_error(std::string("Could not read input: ") +
+                               strerror(errno));
+  }
+}
+
+/*
+ * Turns the raw bytes of a descriptor into plain text, decompressing gzip
+ * and zip input on the way. For zip files, only the first entry is read.
+ */
+class DLL_LOCAL Decoder {
+  enum Mode { PLAIN, STORED, INFLATE };
+
+  const int fd;
+  Mode mode;
+  bool gzip;
+  bool eof;
+  bool finished;
+  uint64_t remaining; // for stored zip entries
+  std::vector<char> in;
+  size_t pos; // of unconsumed input in in
+  size_t len;
+  z_stream z;
+
+  Decoder(const Decoder&);
+  Decoder& operator=(const Decoder&);
+
+  // Reads more raw input, returns false at end of file
+  bool refill()
+  {
+    if ( eof )
+      return false;
+
+    if ( pos < len )
+      std::memmove(in.data(), in.data() + pos, len - pos);
+
+    len -= pos;
+    pos = 0;
+
+    if ( len == in.size() )
+      in.resize(2*in.size());
+
+    const size_t n = read_fd(fd, in.data() + len, in.size() - len);
+    len += n;
+    eof = (n == 0);
+    return n > 0;
+  }
+
+  // Makes sure there are at least n unconsumed bytes, if possible
+  bool need(const size_t n)
+  {
+    while ( len - pos < n )
+      if ( !refill() )
+        return false;
+    return true;
+  }
+
+  uint32_t le(const size_t offset, const size_t bytes) const
+  {
+    uint32_t n = 0;
+    for ( size_t i = bytes; i > 0; --i )
+      n = (n << 8) | static_cast<unsigned char>(in[pos + offset + i - 1]);
+    return n;
+  }
+
+  void start_zip()
+  {
+    // Local file header, see the PKWARE APPNOTE
+    if ( !need(30) )
+      throw std::runtime_error("Truncated zip file");
+
+    const uint32_t flags = le(6, 2);
+    const uint32_t method = le(8, 2);
+    const uint32_t size = le(18, 4);
+    const size_t skip = 30 + le(26, 2) + le(28, 2);
+
+    if ( !need(skip) )
+      throw std::runtime_error("Truncated zip file");
+
+    pos += skip;
+
+    if ( method == Z_DEFLATED ) {
+      start_inflate(-MAX_WBITS);
+    } else if ( method == 0 && !(flags & 8) ) {
+      mode = STORED;
+      remaining = size;
+    } else {
+      throw std::runtime_error("Unsupported zip compression method");
+    }
+  }
+
+  void start_inflate(const int window_bits)
+  {
+    std::memset(&z, 0, sizeof(z));
+
+    if ( inflateInit2(&z, window_bits) != Z_OK )
+      throw std::runtime_error("Could not initialize zlib");
+
+    mode = INFLATE;
+  }
+
+  size_t read_plain(char* out, size_t size)
+  {
+    if ( mode == STORED && size > remaining )
+      size = static_cast<size_t>(remaining);
+
+    size_t n = 0;
+
+    if ( pos < len ) {
+      n = std::min(size, len - pos);
+      std::memcpy(out, in.data() + pos, n);
+      pos += n;
+    } else if ( size > 0 ) {
+      n = read_fd(fd, out, size);
+    }
+
+    if ( mode == STORED ) {
+      if ( n == 0 && remaining > 0 )
+        throw std::runtime_error("Truncated zip file");
+      remaining -= n;
+    }
+
+    return n;
+  }
+
+  size_t read_inflate(char* out, const size_t size)
+  {
+    while ( !finished ) {
+      if ( pos == len )
+        refill();
+
+      z.next_in = reinterpret_cast<Bytef*>(in.data() + pos);
+      z.avail_in = static_cast<uInt>(len - pos);
+      z.next_out = reinterpret_cast<Bytef*>(out);
+      z.avail_out = static_cast<uInt>(size);
+
+      const int ret = inflate(&z, Z_NO_FLUSH);
+      pos = len - z.avail_in;
+      const size_t produced = size - z.avail_out;
+
+      if ( ret == Z_STREAM_END ) {
+        // A gzip file may consist of several members
+        if ( gzip && (pos < len || refill()) )
+          inflateReset(&z);
+        else
+          finished = true;
+      } else if ( ret == Z_BUF_ERROR ) {
+        if ( eof && pos == len )
+          throw std::runtime_error("Unexpected end of compressed data");
+      } else if ( ret != Z_OK ) {
+        throw std::runtime_error(std::string("Decompression failed: ") +
+                                 (z.msg? z.msg : "zlib error"));
+      }
+
+      if ( produced > 0 )
+        return produced;
+    }
+
+    return 0;
+  }
+
+public:
+  Decoder(const int fd_) :
+    fd(fd_),
+    mode(PLAIN),
+    gzip(false),
+    eof(false),
+    finished(false),
+    remaining(0),
+    in(INPUT_SIZE),
+    pos(0),
+    len(0)
+  {
+    need(4);
+
+    if ( is_compressed(in.data(), len) ) {
+      if ( in[0] == 'P' ) {
+        start_zip();
+      } else {
+        gzip = true;
+        start_inflate(MAX_WBITS + 16);
+      }
+    }
+  }
+
+  ~Decoder()
+  {
+    if ( mode == INFLATE )
+      inflateEnd(&z);
+  }
+
+  /*
+   * Reads up to size bytes of plain text. Returns zero at the end.
+   */
+  size_t read(char* out, const size_t size)
+  {
+    return mode == INFLATE? read_inflate(out, size) : read_plain(out, size);
+  }
+};
+
+LineChunks::LineChunks(const int fd_, const size_t chunk_size_,
+    const size_t depth_) :
+  fd(fd_),
+  chunk_size(chunk_size_),
+  depth(depth_),
+  lock(),
+  changed(),
+  chunks(),
+  spare(),
+  error(),
+  done(false),
+  cancelled(false),
+  producer()
+{
+  producer = std::thread(&LineChunks::produce, this);
+}
+
+LineChunks::~LineChunks()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    cancelled = true;
+  }
+  changed.notify_all();
+  producer.join();
+}
+
+void LineChunks::take_spare(std::vector<char>& chunk)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  if ( !spare.empty() ) {
+    chunk.swap(spare.back());
+    spare.pop_back();
+  }
+
+  chunk.clear();
+}
+
+bool LineChunks::push(std::vector<char>& chunk)
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while ( chunks.size() >= depth && !cancelled )
+    changed.wait(guard);
+
+  if ( cancelled )
+    return false;
+
+  chunks.push_back(std::vector<char>());
+  chunks.back().swap(chunk);
+  changed.notify_all();
+  return true;
+}
+
+void LineChunks::produce()
+{
+  try {
+    Decoder decoder(fd);
+    std::vector<char> chunk;
+    std::vector<char> next;
+    std::vector<char> buffer(std::min(INPUT_SIZE, chunk_size));
+    size_t limit = chunk_size;
+    take_spare(chunk);
+
+    for ( ;; ) {
+      // Appended, so the chunk isn't zero-filled first. Recycled chunks
+      // already have the room.
+      chunk.reserve(limit);
+      const size_t n = decoder.read(buffer.data(),
+          std::min(buffer.size(), limit - chunk.size()));
+      chunk.insert(chunk.end(), buffer.data(), buffer.data() + n);
+
+      if ( n == 0 ) {
+        if ( !chunk.empty() ) {
+          if ( chunk.back() != '\n' )
+            chunk.push_back('\n');
+          push(chunk);
+        }
+        break;
+      }
+
+      if ( chunk.size() < limit )
+        continue;
+
+      // Hand out complete lines only, and carry the rest over
+      size_t end = chunk.size();
+      while ( end > 0 && chunk[end - 1] != '\n' )
+        --end;
+
+      if ( end == 0 ) {
+        limit *= 2; // a line longer than a whole chunk
+        continue;
+      }
+
+      take_spare(next);
+      next.insert(next.end(), chunk.begin() + end, chunk.end());
+      chunk.resize(end);
+
+      if ( !push(chunk) )
+        break;
+
+      chunk.swap(next);
+      limit = chunk_size;
+    }
+  } catch ( ... ) {
+    std::lock_guard<std::mutex> guard(lock);
+    error = std::current_exception();
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  done = true;
+  changed.notify_all();
+}
+
+bool LineChunks::next(std::vector<char>& chunk)
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while ( chunks.empty() && !done )
+    changed.wait(guard);
+
+  if ( chunks.empty() ) {
+    if ( error )
+      std::rethrow_exception(error);
+    return false;
+  }
+
+  // Recycle the consumer's old buffer
+  if ( chunk.capacity() > 0 && spare.size() < depth ) {
+    spare.push_back(std::vector<char>());
+    spare.back().swap(chunk);
+  }
+
+  chunk.swap(chunks.front());
+  chunks.pop_front();
+  changed.notify_all();
+  return true;
+}
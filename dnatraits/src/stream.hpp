@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef DNA_STREAM_H
+#define DNA_STREAM_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define BUILDING_DLL
+#include "export.hpp"
+
+/*
+ * Returns true if the given leading bytes of a file are those of a gzip or
+ * zip file.
+ */
+DLL_LOCAL bool is_compressed(const char* magic, const size_t size);
+
+/*
+ * Reads a plain, gzipped or zipped stream from a file descriptor, and hands
+ * it out in chunks of complete lines. Reading and decompression happen in a
+ * background thread, at most a few chunks ahead of the consumer, so parsing
+ * can go on at the same time. Works on pipes and other non-seekable
+ * descriptors, which are read until end of file.
+ */
+class DLL_LOCAL LineChunks {
+  const int fd;
+  const size_t chunk_size;
+  const size_t depth;
+
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::vector<char> > chunks;
+  std::vector<std::vector<char> > spare;
+  std::exception_ptr error;
+  bool done;
+  bool cancelled;
+  std::thread producer;
+
+  void produce();
+  bool push(std::vector<char>& chunk);
+  void take_spare(std::vector<char>& chunk);
+
+  LineChunks(const LineChunks&);
+  LineChunks& operator=(const LineChunks&);
+
+public:
+  LineChunks(const int fd,
+             const size_t chunk_size = 1 << 20,
+             const size_t depth = 4);
+  ~LineChunks();
+
+  /*
+   * Waits for the next chunk and swaps it into the given vector. Each chunk
+   * ends with a newline. Returns false at the end of the stream, and throws
+   * on read or decompression errors.
+   */
+  bool next(std::vector<char>& chunk);
+};
+
+#endif
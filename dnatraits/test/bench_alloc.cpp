@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <utility>
+
+#include "dnatraits.hpp"
+
+/*
+ * Counts every heap allocation made by the program.
+ */
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+  ++allocations;
+  if ( void* p = std::malloc(size? size : 1) )
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+  std::free(p);
+}
+
+/*
+ * Iterates over the whole genome a few times, and reports the allocations
+ * and time per full iteration.
+ */
+static void report(const char* name, const Genome& genome)
+{
+  using namespace std;
+  using namespace std::chrono;
+
+  const int runs = 5;
+  size_t sum = 0;
+  double best = 1e30;
+  const size_t before = allocations;
+
+  for ( int run = 0; run < runs; ++run ) {
+    const auto start = steady_clock::now();
+
+    for ( const auto& p : genome )
+      sum += p.rsid + p.snp.position;
+
+    const duration<double, std::milli> elapsed = steady_clock::now() - start;
+    best = min(best, elapsed.count());
+  }
+
+  const size_t iterated = allocations - before;
+
+  // Copying and comparing iterators
+  const size_t copies_before = allocations;
+  for ( auto i = genome.begin(), end = genome.end(); i != end; ) {
+    auto j = i;
+    i = ++j;
+  }
+  const size_t copied = allocations - copies_before;
+
+  // Keeps the loop from being optimized away
+  if ( sum == 0 )
+    cout << sum;
+
+  cout << fixed << setprecision(2)
+       << name << endl
+       << "  full iteration: " << setw(8) << best << " ms, "
+       << static_cast<double>(iterated) / runs << " allocations" << endl
+       << "  iterator copies: " << copied << " allocations" << endl;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+
+  if ( argc != 2 ) {
+    cerr << "Usage: bench_alloc genome.txt" << endl;
+    return 1;
+  }
+
+  Genome genome;
+  parse_file(argv[1], genome);
+
+  Genome sorted(0, STORAGE_SORTED);
+  parse_file(argv[1], sorted);
+
+  cout << "Iterating over " << genome.size() << " SNPs" << endl << endl;
+
+  report("Hash table", genome);
+  report("Sorted", sorted);
+
+  size_t before = allocations;
+  Genome moved(std::move(sorted));
+  sorted = std::move(moved);
+  cout << endl << "Moving a genome back and forth: "
+       << allocations - before << " allocations" << endl;
+
+  before = allocations;
+  Genome copy(sorted);
+  cout << "Copying a genome: " << allocations - before << " allocations"
+       << endl;
+
+  return 0;
+}
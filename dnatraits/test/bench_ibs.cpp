@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include "dnatraits.hpp"
+
+/*
+ * A genome like the given one, with some SNPs missing and some genotypes
+ * changed.
+ */
+static Genome mutate(const Genome& genome, std::mt19937& random)
+{
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  Genome r(genome.size());
+  for ( const auto p : genome ) {
+    const int roll = percent(random);
+    if ( roll < 5 )
+      continue;
+
+    SNP snp(p.snp);
+    if ( roll < 25 )
+      snp.genotype = Genotype(snp.genotype.first, snp.genotype.first);
+    r.insert(p.rsid, snp);
+  }
+
+  return r;
+}
+
+static double seconds_since(const std::chrono::steady_clock::time_point& t)
+{
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now() - t).count();
+}
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+  using namespace std::chrono;
+
+  if ( argc < 2 ) {
+    cerr << "Usage: bench_ibs genome.txt [samples]" << endl;
+    return 1;
+  }
+
+  const size_t count = argc > 2? atoi(argv[2]) : 128;
+
+  Genome genome;
+  parse_file(argv[1], genome);
+
+  mt19937 random(42);
+  vector<Genome> genomes;
+  Cohort cohort;
+
+  for ( size_t n = 0; n < count; ++n ) {
+    Genome g(mutate(genome, random));
+    cohort.add(g);
+    if ( genomes.size() < 16 )
+      genomes.push_back(std::move(g));
+  }
+
+  const double pairs = count*(count - 1) / 2.0;
+
+  cout << fixed << setprecision(1)
+       << count << " samples, " << cohort.markers() << " markers, "
+       << cohort.memory() / (1024*1024) << " MB" << endl << endl;
+
+  // The old way, one pair at a time
+  auto start = steady_clock::now();
+  size_t same = 0;
+  for ( size_t i = 0; i < genomes.size(); ++i )
+    for ( size_t j = i + 1; j < genomes.size(); ++j )
+      same += genomes[i].intersect_snp(genomes[j]).size();
+  const double each = seconds_since(start) /
+    (genomes.size()*(genomes.size() - 1) / 2);
+
+  cout << "intersect_snp: " << setw(10) << 1/each << " pairs/s" << endl;
+
+  for ( const unsigned threads : {1u, 0u} ) {
+    start = steady_clock::now();
+    size_t ibs2 = 0;
+    cohort.ibs([&](size_t, size_t, const IBSCounts& c) {
+      ibs2 += c.ibs2;
+    }, threads);
+    const double elapsed = seconds_since(start);
+
+    cout << "ibs, " << (threads? "1 thread: " : "all threads:")
+         << setw(10) << pairs / elapsed << " pairs/s" << endl;
+
+    // Keeps the work from being optimized away
+    if ( ibs2 + same == 0 )
+      cout << endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include "dnatraits.hpp"
+
+/*
+ * Returns the best of a few runs of f, in milliseconds.
+ */
+template<class F>
+static double best_of(F f)
+{
+  using namespace std::chrono;
+
+  double best = 1e30;
+
+  for ( int run = 0; run < 5; ++run ) {
+    const auto start = steady_clock::now();
+    f();
+    const duration<double, std::milli> elapsed = steady_clock::now() - start;
+    best = std::min(best, elapsed.count());
+  }
+
+  return best;
+}
+
+static void report(const char* name, const Genome& a, const Genome& b)
+{
+  using namespace std;
+
+  size_t n = 0;
+  const double list = best_of([&]() { n += a.intersect_snp(b).size(); });
+  const double count = best_of([&]() { n += a.intersect_snp_count(b); });
+  const double parallel = best_of([&]() { n += a.intersect_snp_count(b, 0); });
+
+  cout << fixed << setprecision(2)
+       << name << " (" << a.intersect_snp_count(b) << " in common)" << endl
+       << "  list:     " << setw(8) << list << " ms" << endl
+       << "  count:    " << setw(8) << count << " ms" << endl
+       << "  parallel: " << setw(8) << parallel << " ms" << endl;
+
+  // Keeps the calls from being optimized away
+  if ( n == static_cast<size_t>(-1) )
+    cout << n;
+}
+
+/*
+ * A genome like the given one, but with some SNPs missing and some others
+ * changed, like a relative's.
+ */
+static Genome relative(const Genome& genome, const Storage storage)
+{
+  std::mt19937 random(42);
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  Genome r(0, storage);
+  for ( const auto p : genome ) {
+    const int roll = percent(random);
+    if ( roll < 10 )
+      continue;
+
+    SNP snp(p.snp);
+    if ( roll < 30 )
+      snp.genotype = Genotype(snp.genotype.second, snp.genotype.second);
+    r.insert(p.rsid, snp);
+  }
+  r.compact();
+
+  return r;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+
+  if ( argc != 2 ) {
+    cerr << "Usage: bench_intersect genome.txt" << endl;
+    return 1;
+  }
+
+  Genome hashed;
+  parse_file(argv[1], hashed);
+
+  Genome sorted(0, STORAGE_SORTED);
+  parse_file(argv[1], sorted);
+
+  report("Hash table", hashed, relative(hashed, STORAGE_HASH));
+  report("Sorted", sorted, relative(sorted, STORAGE_SORTED));
+
+  return 0;
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "dnatraits.hpp"
+
+/*
+ * Returns the best of a few runs of looking up all the RSIDs, in
+ * nanoseconds per lookup.
+ */
+static double time_lookups(const Genome& genome, const std::vector<RSID>& ids)
+{
+  using namespace std::chrono;
+
+  double best = 1e30;
+  size_t found = 0;
+
+  for ( int run = 0; run < 5; ++run ) {
+    const auto start = steady_clock::now();
+
+    for ( const auto id : ids )
+      found += genome.has(id);
+
+    const duration<double, std::nano> elapsed = steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / ids.size());
+  }
+
+  // Keeps the lookups from being optimized away
+  if ( found == static_cast<size_t>(-1) )
+    std::cout << found;
+
+  return best;
+}
+
+/*
+ * Like time_lookups(), but looks up batches of RSIDs at a time.
+ */
+static double time_batches(const Genome& genome, const std::vector<RSID>& ids)
+{
+  using namespace std::chrono;
+
+  const size_t batch = 2000;
+  std::vector<SNP> snps(batch);
+  double best = 1e30;
+  size_t found = 0;
+
+  for ( int run = 0; run < 5; ++run ) {
+    const auto start = steady_clock::now();
+
+    for ( size_t n = 0; n < ids.size(); n += batch )
+      found += genome.lookup(&ids[n], std::min(batch, ids.size() - n),
+                             snps.data());
+
+    const duration<double, std::nano> elapsed = steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / ids.size());
+  }
+
+  if ( found == static_cast<size_t>(-1) )
+    std::cout << found;
+
+  return best;
+}
+
+static void report(const char* name, Genome& genome,
+    const std::vector<RSID>& hits, const std::vector<RSID>& misses)
+{
+  using namespace std;
+
+  genome.build_filter();
+  const double hit = time_lookups(genome, hits);
+  const double miss = time_lookups(genome, misses);
+  const double hit_batched = time_batches(genome, hits);
+  const double miss_batched = time_batches(genome, misses);
+
+  genome.drop_filter();
+  const double hit_plain = time_lookups(genome, hits);
+  const double miss_plain = time_lookups(genome, misses);
+
+  cout << fixed << setprecision(1)
+       << name << endl
+       << "  hit:  " << setw(6) << hit_plain << " ns without filter, "
+       << setw(6) << hit << " ns with" << endl
+       << "  miss: " << setw(6) << miss_plain << " ns without filter, "
+       << setw(6) << miss << " ns with" << endl
+       << "  batches of 2000: " << setw(6) << hit_batched << " ns per hit, "
+       << setw(6) << miss_batched << " ns per miss" << endl;
+}
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+
+  if ( argc != 2 ) {
+    cerr << "Usage: bench_lookup genome.txt" << endl;
+    return 1;
+  }
+
+  Genome genome;
+  parse_file(argv[1], genome);
+
+  // Present RSIDs in random order, and as many random absent ones
+  mt19937 random(42);
+  vector<RSID> hits = genome.rsids();
+  shuffle(hits.begin(), hits.end(), random);
+
+  uniform_int_distribution<RSID> any(1, genome.last);
+  vector<RSID> misses;
+  while ( misses.size() < hits.size() ) {
+    const RSID id = any(random);
+    if ( !genome.has(id) )
+      misses.push_back(id);
+  }
+
+  cout << "Looking up " << hits.size() << " present and absent RSIDs"
+       << endl << endl;
+
+  report("Hash table", genome, hits, misses);
+
+  Genome sorted(0, STORAGE_SORTED);
+  parse_file(argv[1], sorted);
+  report("Sorted", sorted, hits, misses);
+
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#include "dnatraits.hpp"
+
+/*
+ * A genome like the given one, with some SNPs missing and some genotypes
+ * changed.
+ */
+static Genome mutate(const Genome& genome, std::mt19937& random)
+{
+  std::uniform_int_distribution<int> percent(0, 99);
+
+  Genome r(genome.size());
+  for ( const auto p : genome ) {
+    const int roll = percent(random);
+    if ( roll < 5 )
+      continue;
+
+    SNP snp(p.snp);
+    if ( roll < 25 )
+      snp.genotype = Genotype(snp.genotype.second, snp.genotype.second);
+    r.insert(p.rsid, snp);
+  }
+
+  return r;
+}
+
+static double seconds_since(const std::chrono::steady_clock::time_point& t)
+{
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now() - t).count();
+}
+
+int main(int argc, char** argv)
+{
+  using namespace std;
+  using namespace std::chrono;
+
+  if ( argc < 2 ) {
+    cerr << "Usage: bench_score genome.txt [samples] [variants]" << endl;
+    return 1;
+  }
+
+  const size_t count = argc > 2? atoi(argv[2]) : 64;
+  const size_t variants = argc > 3? atoi(argv[3]) : 100000;
+
+  Genome genome;
+  parse_file(argv[1], genome);
+
+  // Every so many SNPs, with random weights
+  mt19937 random(42);
+  normal_distribution<double> weight(0, 0.01);
+  PolygenicScore model;
+  const size_t step = max<size_t>(1, genome.size() / variants);
+  size_t n = 0;
+  for ( const auto p : genome )
+    if ( n++ % step == 0 && model.size() < variants )
+      model.add(p.rsid, p.snp.genotype.first, weight(random),
+                p.snp.genotype.second);
+
+  vector<Genome> genomes;
+  vector<const Genome*> pointers;
+  Cohort cohort;
+
+  for ( size_t i = 0; i < count; ++i ) {
+    genomes.push_back(mutate(genome, random));
+    cohort.add(genomes.back());
+  }
+  for ( const auto& g : genomes )
+    pointers.push_back(&g);
+
+  cout << fixed << setprecision(1)
+       << count << " samples, " << model.size() << " variants" << endl
+       << endl;
+
+  // The old way, one SNP at a time
+  const auto rsids = model.rsids();
+  auto start = steady_clock::now();
+  double total = 0;
+  for ( const auto& g : genomes )
+    for ( const auto rsid : rsids )
+      total += g.has(rsid) && g[rsid].genotype.first == A;
+  cout << "operator[]:           " << setw(10)
+       << count / seconds_since(start) << " samples/s" << endl;
+
+  for ( const unsigned threads : {1u, 0u} ) {
+    start = steady_clock::now();
+    for ( const auto& s : model.score(pointers, threads) )
+      total += s.sum;
+    cout << "genomes, " << (threads? "1 thread:   " : "all threads:")
+         << setw(10) << count / seconds_since(start) << " samples/s" << endl;
+
+    start = steady_clock::now();
+    for ( const auto& s : cohort.score(model, threads) )
+      total += s.sum;
+    cout << "cohort, " << (threads? "1 thread:    " : "all threads: ")
+         << setw(10) << count / seconds_since(start) << " samples/s" << endl;
+  }
+
+  // Keeps the work from being optimized away
+  if ( total == 0 )
+    cout << endl;
+
+  return 0;
+}
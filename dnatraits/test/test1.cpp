@@ -3,8 +3,11 @@
  * Distributed under the GPL v3 or later. See COPYING.
  */
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <sstream>
+#include <stdexcept>
 #include <unistd.h>
 #include <cassert>
 
@@ -24,12 +27,19 @@ static std::string format(const Genome& genome, const RSID& id)
  */
 static bool gs237(const Genome& genome)
 {
-  return genome[ 4778241] ==  CC
-      && genome[12913832] ==  GG
-      && genome[ 7495174] ==  AA
-      && genome[ 8028689] ==  TT
-      && genome[ 7183877] ==  CC
-      && genome[ 1800401] == ~CC;
+  static const RSID rsids[] = {
+    4778241, 12913832, 7495174, 8028689, 7183877, 1800401
+  };
+
+  SNP snps[6];
+  genome.lookup(rsids, 6, snps);
+
+  return snps[0] ==  CC
+      && snps[1] ==  GG
+      && snps[2] ==  AA
+      && snps[3] ==  TT
+      && snps[4] ==  CC
+      && snps[5] == ~CC;
 }
 
 static std::string skin_color_1426654(const Genome& genome)
@@ -82,6 +92,381 @@ void test_iterator(const Genome& genome)
   cout << "Iterator test 1: " << (n == genome.size()? "OK" : "FAIL") << endl;
   cout << "Iterator test 2: " << (last.snp == actual_last? "OK" : "FAIL") << endl;
   cout << "Iterator test 3: " << (last.rsid == genome.last? "OK" : "FAIL") << endl;
+
+  size_t internal=0;
+  for ( auto i = genome.internal_begin(); i != genome.internal_end(); ++i )
+    if ( genome.internal((*i).rsid) == (*i).snp ) ++internal;
+
+  cout << "Iterator test 4: " << (internal == genome.internal_size()? "OK" : "FAIL") << endl;
+
+  Genome copy(genome);
+  Genome moved(std::move(copy));
+  auto it = moved.begin();
+  cout << "Iterator test 5: " << (moved == genome && it->snp == genome[it->rsid]? "OK" : "FAIL") << endl;
+
+  // Moved-from genomes stay usable
+  copy.insert(1, SNP(CHR1, 1, AA));
+  cout << "Iterator test 6: " << (copy.size() == 1 && copy.begin() != copy.end()? "OK" : "FAIL") << endl;
+
+  // Move assignment empties the source, too
+  copy = std::move(moved);
+  cout << "Iterator test 7: " << (copy == genome && moved.size() == 0 && moved.begin() == moved.end() && moved.first == 0xffffffff && moved.last == 0 && !moved.y_chromosome? "OK" : "FAIL") << endl;
+  cout << endl;
+}
+
+void test_snapshot(const Genome& genome)
+{
+  using namespace std;
+  const string name = "test1-snapshot.tmp";
+
+  genome.save(name);
+  Genome loaded(0);
+  loaded.load(name, true);
+
+  // Saving over a loaded snapshot must leave its mapping intact
+  genome.save(name);
+  unlink(name.c_str());
+
+  size_t n=0;
+  for ( const auto p : loaded )
+    if ( genome[p.rsid] == p.snp ) ++n;
+
+  cout << "Snapshot test 1: " << (loaded == genome? "OK" : "FAIL") << endl;
+  cout << "Snapshot test 2: " << (genome == loaded? "OK" : "FAIL") << endl;
+  cout << "Snapshot test 3: " << (n == genome.size()? "OK" : "FAIL") << endl;
+
+  // Batched lookups, with some RSIDs missing
+  std::vector<RSID> rsids;
+  for ( const auto p : genome )
+    rsids.push_back(p.rsid + (rsids.size() % 3 == 0));
+  std::vector<SNP> expected(rsids.size()), found(rsids.size());
+  genome.lookup(rsids.data(), rsids.size(), expected.data());
+  loaded.lookup(rsids.data(), rsids.size(), found.data());
+
+  cout << "Snapshot test 4: " << (found == expected? "OK" : "FAIL") << endl;
+
+  const string shared = "/test1-snapshot";
+  genome.publish(shared);
+  Genome attached;
+  attached.attach(shared);
+  const bool removed = Genome::unpublish(shared);
+
+  cout << "Snapshot test 5: " << (removed && attached == genome? "OK" : "FAIL") << endl;
+  cout << endl;
+}
+
+void test_storage(const std::string& file, const Genome& genome)
+{
+  using namespace std;
+
+  Genome sorted(0, STORAGE_SORTED);
+  parse_file(file, sorted);
+
+  bool ordered = true;
+  RSID previous = 0;
+  for ( const auto p : sorted ) {
+    ordered &= previous < p.rsid;
+    previous = p.rsid;
+  }
+
+  sorted.insert(1, SNP(CHR1, 42, AA));
+
+  cout << "Storage test 1: " << (sorted.size() == genome.size() + 1? "OK" : "FAIL") << endl;
+  cout << "Storage test 2: " << (ordered? "OK" : "FAIL") << endl;
+  cout << "Storage test 3: " << (sorted[1] == SNP(CHR1, 42, AA)? "OK" : "FAIL") << endl;
+  cout << "Storage test 4: " << (sorted.intersect_snp(genome).size() == genome.size()? "OK" : "FAIL") << endl;
+
+  // A big batch is merged in one go, and existing RSIDs are left alone
+  vector<RSID> ids;
+  vector<SNP> snps;
+  for ( const auto p : genome ) {
+    ids.push_back(p.rsid);
+    snps.push_back(SNP(CHR1, 1, TT));
+  }
+  ids.push_back(2); snps.push_back(SNP(CHR1, 43, CC));
+  ids.push_back(2); snps.push_back(SNP(CHR1, 44, GG));
+  ids.push_back(1); snps.push_back(SNP(CHR1, 45, GG));
+  sorted.insert_many(ids.data(), snps.data(), ids.size());
+
+  cout << "Storage test 5: " << (sorted.size() == genome.size() + 2 && sorted[2] == SNP(CHR1, 43, CC) && sorted[1] == SNP(CHR1, 42, AA) && sorted.intersect_snp_count(genome) == genome.size()? "OK" : "FAIL") << endl;
+  cout << endl;
+
+  // Both sorted, so the RSID arrays are merged
+  Genome other(0, STORAGE_SORTED);
+  for ( RSID id = 1; id < genome.last; id += 7 )
+    other.insert(id, SNP(CHR1, id, AA));
+  other.compact();
+
+  const auto common = sorted.intersect_rsid(other);
+  const auto parallel = sorted.intersect_rsid(other, 4);
+  bool found = std::is_sorted(common.begin(), common.end());
+  for ( const auto id : common )
+    found &= sorted.has(id) && other.has(id);
+
+  size_t expected = 0;
+  for ( const auto p : other )
+    expected += sorted.has(p.rsid);
+
+  cout << "Intersect test 1: " << (found && common.size() == expected? "OK" : "FAIL") << endl;
+  cout << "Intersect test 2: " << (parallel == common && sorted.intersect_rsid_count(other, 0) == expected? "OK" : "FAIL") << endl;
+  cout << "Intersect test 3: " << (sorted.intersect_snp_count(other) == sorted.intersect_snp(other).size()? "OK" : "FAIL") << endl;
+  cout << endl;
+}
+
+void test_packed(const Genome& genome)
+{
+  using namespace std;
+
+  size_t same = 0, complemented = 0;
+  for ( const auto p : genome ) {
+    const PackedSNP packed(p.snp);
+    const SNP snp = packed.snp();
+
+    same += snp.chromosome == p.snp.chromosome &&
+            snp.position == p.snp.position &&
+            packed == p.snp.genotype;
+
+    complemented += ~packed == ~p.snp.genotype;
+  }
+
+  cout << "Packed test 1: " << (same == genome.size()? "OK" : "FAIL") << endl;
+  cout << "Packed test 2: " << (complemented == genome.size()? "OK" : "FAIL") << endl;
+  cout << "Packed test 3: " << (PackedSNP().empty() && PackedSNP(SNP(CHR1, 1, GA)) == AG? "OK" : "FAIL") << endl;
+  cout << endl;
+}
+
+void test_find(const Genome& genome)
+{
+  using namespace std;
+
+  size_t y = 0, middle = 0;
+  for ( const auto p : genome ) {
+    y += p.snp.chromosome == CHR_Y;
+    middle += p.snp.chromosome == CHR15 && p.snp.position >= 28000000
+                                        && p.snp.position < 28500000;
+  }
+
+  const SNPSpan all = genome.find(CHR_Y);
+  bool ordered = true;
+  for ( size_t n = 1; n < all.size; ++n )
+    ordered &= all.snps[n-1].position <= all.snps[n].position;
+
+  const SNPSpan range = genome.find(CHR15, 28000000, 28500000);
+
+  cout << "Find test 1: " << (all.size == y && ordered? "OK" : "FAIL") << endl;
+  cout << "Find test 2: " << (range.size == middle? "OK" : "FAIL") << endl;
+  cout << "Find test 3: " << (all.empty() || genome[all.rsids[0]] == all.snps[0]? "OK" : "FAIL") << endl;
+
+  // Chromosomes past CHR_Y fit in the bitfield, but aren't indexed
+  Genome odd;
+  odd.insert(1, SNP(CHR_Y, 10, AA));
+  odd.insert(2, SNP(static_cast<Chromosome>(31), 10, AA));
+  cout << "Find test 4: " << (odd.find(CHR_Y).size == 1? "OK" : "FAIL") << endl;
+  cout << endl;
+}
+
+void test_cohort(const Genome& genome)
+{
+  using namespace std;
+
+  // A relative with some genotypes flipped, some of them into reverse order
+  Genome other;
+  for ( const auto p : genome ) {
+    SNP snp(p.snp);
+    if ( p.rsid % 3 == 0 )
+      snp.genotype = Genotype(snp.genotype.second, snp.genotype.first);
+    other.insert(p.rsid, snp);
+  }
+
+  Cohort cohort;
+  cohort.add(genome);
+  cohort.add(other);
+
+  size_t called = 0, same = 0;
+  for ( const auto p : genome ) {
+    if ( p.snp.genotype == NN )
+      continue;
+    ++called;
+    same += cohort[0][p.rsid] == p.snp && cohort[1][p.rsid] == other[p.rsid];
+  }
+
+  cout << "Cohort test 1: " << (cohort.size() == 2 && cohort.markers() == genome.size()? "OK" : "FAIL") << endl;
+  cout << "Cohort test 2: " << (same == called && cohort[1].size() == called? "OK" : "FAIL") << endl;
+  cout << "Cohort test 3: " << (cohort[0].genome().intersect_snp_count(genome) == called? "OK" : "FAIL") << endl;
+  cout << "Cohort size: " << cohort.memory() / 1024 << " kB" << endl;
+
+  // Moved-from cohorts stay usable
+  Cohort moved(std::move(cohort));
+  cout << "Cohort test 4: " << (moved.size() == 2 && cohort.size() == 0 && cohort.add(genome) == 0? "OK" : "FAIL") << endl;
+  cout << endl;
+
+  Genome a, b;
+  a.insert(1, SNP(CHR1, 10, AA)); b.insert(1, SNP(CHR1, 10, AA)); // IBS2
+  a.insert(2, SNP(CHR1, 20, AG)); b.insert(2, SNP(CHR1, 20, GG)); // IBS1
+  a.insert(3, SNP(CHR1, 30, GG)); b.insert(3, SNP(CHR1, 30, AA)); // IBS0
+  a.insert(4, SNP(CHR1, 40, AA)); b.insert(4, SNP(CHR1, 40, AG)); // IBS1
+  a.insert(5, SNP(CHR1, 50, NN)); b.insert(5, SNP(CHR1, 50, AA)); // no call
+
+  Cohort pair;
+  pair.add(a);
+  pair.add(b);
+  pair.add(genome);
+  pair.add(genome);
+
+  const auto m = pair.ibs(2);
+  const IBSCounts& ab = m[0*4 + 1];
+  const IBSCounts& gg = m[2*4 + 3];
+
+  size_t streamed = 0;
+  pair.ibs([&](size_t i, size_t j, const IBSCounts& c) {
+    streamed += i < j && c.ibs2 == m[i*4 + j].ibs2 && c.ibs0 == m[j*4 + i].ibs0;
+  });
+
+  cout << "IBS test 1: " << (ab.ibs0 == 1 && ab.ibs1 == 2 && ab.ibs2 == 1? "OK" : "FAIL") << endl;
+  cout << "IBS test 2: " << (gg.ibs0 == 0 && gg.ibs1 == 0 && gg.ibs2 == m[2*4 + 2].ibs2 && gg.ibs2 > 0? "OK" : "FAIL") << endl;
+  cout << "IBS test 3: " << (streamed == 6? "OK" : "FAIL") << endl;
+
+  // Heterozygotes in either order pack the same, and keep their order
+  Genome ag, ga, hom;
+  ag.insert(1, SNP(CHR1, 10, AG)); ga.insert(1, SNP(CHR1, 10, GA)); hom.insert(1, SNP(CHR1, 10, GG));
+  ag.insert(2, SNP(CHR1, 20, GA)); ga.insert(2, SNP(CHR1, 20, AG)); hom.insert(2, SNP(CHR1, 20, AA));
+
+  Cohort mixed;
+  mixed.add(ag);
+  mixed.add(ga);
+  mixed.add(hom);
+
+  const auto x = mixed.ibs();
+  cout << "IBS test 4: " << (x[0*3 + 1].ibs2 == 2 && x[0*3 + 1].ibs1 == 0 && x[0*3 + 2].ibs1 == 2 && x[1*3 + 2].ibs1 == 2? "OK" : "FAIL") << endl;
+  cout << "IBS test 5: " << (mixed[0][1].genotype == AG && mixed[0][2].genotype == GA && mixed[1][1].genotype == GA && mixed[1][2].genotype == AG? "OK" : "FAIL") << endl;
+  cout << endl;
+}
+
+void test_rules(const Genome& genome)
+{
+  using namespace std;
+
+  const RuleSet rules(
+    "# gs237, as above\n"
+    "gs237: rs4778241 CC & rs12913832 GG & rs7495174 AA & rs8028689 TT\n"
+    "       & rs7183877 CC & rs1800401 ~CC\n"
+    "light: rs1426654 AA\n"
+    "mixed: rs1426654 AG | rs1426654 TT & rs1426654 --\n"
+    "dark:  rs1426654 ~CC\n");
+
+  const auto r = rules.evaluate(genome);
+  const string skin = skin_color_1426654(genome);
+
+  bool bad_syntax = false;
+  try {
+    RuleSet("oops: rs1426654 AA &\n");
+  } catch ( const invalid_argument& ) {
+    bad_syntax = true;
+  }
+
+  // The test genome has no call for rs1426654
+  Genome mixed, dark;
+  mixed.insert(1426654, SNP(CHR15, 48426484, GA));
+  dark.insert(1426654, SNP(CHR15, 48426484, GG));
+  const auto m = rules.evaluate(mixed);
+  const auto d = rules.evaluate(dark);
+
+  Cohort cohort;
+  cohort.add(genome);
+  const vector<const Genome*> batch(3, &genome);
+  const auto b = rules.evaluate(batch, 2);
+  const auto c = rules.evaluate(cohort);
+
+  cout << "Rules test 1: " << (rules.size() == 4 && rules.rsids().size() == 7 && rules.find("dark") == 3? "OK" : "FAIL") << endl;
+  cout << "Rules test 2: " << (r[0] == gs237(genome)? "OK" : "FAIL") << endl;
+  cout << "Rules test 3: " << (r[1] == (skin[9] == 'l') && r[2] == (skin[0] == 'M') && r[3] == (skin[9] == 'd')? "OK" : "FAIL") << endl;
+  cout << "Rules test 4: " << (!m[1] && m[2] && !m[3] && !d[1] && !d[2] && d[3]? "OK" : "FAIL") << endl;
+  cout << "Rules test 5: " << (b.size() == 12 && equal(r.begin(), r.end(), b.begin() + 8) && c == r? "OK" : "FAIL") << endl;
+  cout << "Rules test 6: " << (bad_syntax? "OK" : "FAIL") << endl;
+  cout << endl;
+}
+
+void test_score(const Genome& genome)
+{
+  using namespace std;
+
+  // One of each: forward, reverse strand, no other allele, third allele,
+  // no call and missing
+  Genome small;
+  small.insert(1, SNP(CHR1, 10, AG));
+  small.insert(2, SNP(CHR1, 20, TC));
+  small.insert(3, SNP(CHR1, 30, AA));
+  small.insert(4, SNP(CHR1, 40, GT));
+  small.insert(5, SNP(CHR1, 50, NN));
+
+  PolygenicScore strand;
+  strand.add(1, A, 1, G);
+  strand.add(2, A, 2, G);
+  strand.add(3, A, 4);
+  strand.add(4, A, 8, G);
+  strand.add(5, A, 16, G);
+  strand.add(6, A, 32, G);
+  const ScoreSum s = strand.score(small);
+
+  const string name = "test1-weights.tmp";
+  {
+    ofstream f(name.c_str());
+    f << "rsid\teffect\tweight\tother\n"
+      << "# comment\n"
+      << "rs1\tA\t1\tG\n"
+      << "rs2\tAT\t5\tA\n" // not a SNP
+      << "rs2\tA\t2e0\tG\n"
+      << "rs3\tA\t4\n";
+  }
+  PolygenicScore loaded;
+  const size_t skipped = loaded.load(name);
+  unlink(name.c_str());
+  const ScoreSum l = loaded.score(small);
+
+  // A model over every seventh SNP, scored every way
+  PolygenicScore model;
+  for ( const auto p : genome )
+    if ( p.rsid % 7 == 0 )
+      model.add(p.rsid, p.snp.genotype.first, (p.rsid % 13) - 6.0,
+                p.snp.genotype.second);
+
+  Cohort cohort;
+  cohort.add(genome);
+  cohort.add(small);
+  const auto c = cohort.score(model, 2);
+  const ScoreSum g = model.score(genome);
+  const auto b = model.score(vector<const Genome*>(3, &genome), 2);
+
+  cout << "Score test 1: " << (s.sum == 11 && s.variants == 3? "OK" : "FAIL") << endl;
+  cout << "Score test 2: " << (skipped == 1 && loaded.size() == 3 && l.sum == 11 && l.variants == 3? "OK" : "FAIL") << endl;
+  cout << "Score test 3: " << (g.variants > 0 && c[0].sum == g.sum && c[0].variants == g.variants? "OK" : "FAIL") << endl;
+  cout << "Score test 4: " << (b[2].sum == g.sum && b[2].variants == g.variants && c[1].variants == 0? "OK" : "FAIL") << endl;
+  cout << endl;
+}
+
+void test_columns(const Genome& genome)
+{
+  using namespace std;
+
+  const GenomeColumns columns = genome.columns();
+
+  size_t y = 0, nocalls = 0, hetero = 0;
+  for ( const auto p : genome ) {
+    const Genotype& g = p.snp.genotype;
+    y += p.snp.chromosome == CHR_Y;
+    nocalls += g == NN;
+    hetero += g.first != NONE && g.second != NONE && g.first != g.second;
+  }
+
+  const auto ys = columns.select(CHR_Y);
+  bool same = true;
+  for ( const auto id : ys )
+    same &= genome[id].chromosome == CHR_Y;
+
+  cout << "Columns test 1: " << (columns.size() == genome.size() && columns.count(CHR_Y) == y? "OK" : "FAIL") << endl;
+  cout << "Columns test 2: " << (ys.size() == y && same? "OK" : "FAIL") << endl;
+  cout << "Columns test 3: " << (columns.count_genotypes(GenomeColumns::no_calls()) == nocalls? "OK" : "FAIL") << endl;
+  cout << "Columns test 4: " << (columns.count_genotypes(GenomeColumns::heterozygous()) == hetero? "OK" : "FAIL") << endl;
   cout << endl;
 }
 
@@ -95,13 +480,21 @@ int main(int argc, char** argv)
       cout << "Reading " << file << " ... ";
       cout.flush();
 
-      Genome genome(1000000);
+      Genome genome;
       parse_file(file, genome);
 
       cout << "done" << endl; cout.flush();
       cout << "Read " << genome.size() << " unique SNPs" << endl << endl;
 
       test_iterator(genome);
+      test_snapshot(genome);
+      test_storage(file, genome);
+      test_packed(genome);
+      test_columns(genome);
+      test_find(genome);
+      test_cohort(genome);
+      test_rules(genome);
+      test_score(genome);
 
 #ifdef DEBUG
       cout << "Size of Genotype: " << sizeof(Genotype) << endl
@@ -126,6 +519,7 @@ int main(int argc, char** argv)
            << "  sizeof(Position) = " << sizeof(Position) << endl
            << "  sizeof(RSID) = " << sizeof(RSID) << endl
            << "  sizeof(SNP) = " << sizeof(SNP) << endl
+           << "  sizeof(PackedSNP) = " << sizeof(PackedSNP) << endl
            << "  load factor = " << genome.load_factor() << endl;
     }
 
@@ -54,23 +54,30 @@ rules = {
     },
 }
 
-def check(filename):
+def compile_rules():
+    """Turns each genotype of the rules into a rule of its own, named by
+    RSID and genotype. A trailing dash on the RSID matches the
+    complement."""
+    text = []
+    for rsid, genotypes in sorted(rules.items()):
+        tilde = "~" if rsid.endswith("-") else ""
+        rsid = rsid.rstrip("-")
+        for genotype in sorted(genotypes):
+            text.append("%s_%s: %s %s%s" % (rsid, genotype, rsid, tilde,
+                genotype))
+    return dt.RuleSet("\n".join(text))
+
+def check(filename, compiled):
     print(filename)
     genome = dt.parse(filename)
+    result = compiled.evaluate(genome)
 
     for rsid, genotypes in sorted(rules.items()):
-        negative = False
-        if rsid.endswith("-"):
-            negative = True
-            rsid = rsid[:-1]
-
-        snp = genome[rsid]
-        if negative:
-            snp = ~snp
+        rsid = rsid.rstrip("-")
 
         hit = False
-        for genotype, descr in genotypes.items():
-            if snp == genotype:
+        for genotype, descr in sorted(genotypes.items()):
+            if result["%s_%s" % (rsid, genotype)]:
                 hit = True
                 lines = descr.split("\n")
                 print("%10s %2s: %s" % (rsid, genotype, lines[0]))
@@ -86,4 +93,6 @@ if __name__ == "__main__":
         print("NOTE: This is *very* speculative, and may even be erronous!")
         print("Data taken from www.snpedia.com, but code here may be wrong")
         print("")
-    map(check, sys.argv[1:])
+    compiled = compile_rules()
+    for filename in sys.argv[1:]:
+        check(filename, compiled)
@@ -8,7 +8,26 @@ Distributed under the GPL v3 or later. See COPYING.
 from genome import Genome, GenomeIterator
 from match import unphased_match
 from nucleotide import Nucleotide
-from parse import parse
+from parse import (
+    ADVISE_HUGEPAGES,
+    ADVISE_POPULATE,
+    ADVISE_SEQUENTIAL,
+    ADVISE_WILLNEED,
+    CHROMOSOME_CODES,
+    GENOTYPE_CODES,
+    STORAGE_HASH,
+    STORAGE_SORTED,
+    attach,
+    load,
+    parse,
+    parse_buffer,
+    parse_files,
+    parse_stream,
+    prefetch,
+    unpublish,
+)
+from rules import RuleSet
+from score import PolygenicScore
 from snp import SNP
 
 __author__ = "Christian Stigen Larsen"
@@ -18,10 +37,27 @@ __license__ = "GNU General Public License v3"
 __version__ = "1.0"
 
 __all__ = [
+    "ADVISE_HUGEPAGES",
+    "ADVISE_POPULATE",
+    "ADVISE_SEQUENTIAL",
+    "ADVISE_WILLNEED",
+    "CHROMOSOME_CODES",
+    "GENOTYPE_CODES",
+    "STORAGE_HASH",
+    "STORAGE_SORTED",
     "Genome",
     "GenomeIterator",
     "Nucleotide",
+    "PolygenicScore",
+    "RuleSet",
     "SNP",
+    "attach",
+    "load",
     "parse",
+    "parse_buffer",
+    "parse_files",
+    "parse_stream",
+    "prefetch",
     "unphased_match",
+    "unpublish",
 ]
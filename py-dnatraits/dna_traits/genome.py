@@ -12,22 +12,30 @@ def _to_snp(rsid, orientation, value):
 
 
 class GenomeIterator:
+    """Iterates over the SNPs of a genome, sorted by RSID."""
+
     def __init__(self, genome, start=-1):
-        self._genome = genome
-        self._rsids = self._genome.rsids
-        self._len = len(self._rsids)
-        self._index = 0 if start==-1 else start
+        self._orientation = genome._orientation
+        self._items = genome._genome.items()
+        self._genotypes = {}
+
+        for n in xrange(max(start, 0)):
+            next(self._items, None)
 
     def __iter__(self):
         return self
 
     def next(self):
-        if self._index < self._len:
-            rsid = self._rsids[self._index]
-            self._index += 1
-            return self._genome.snp(rsid)
-        else:
-            raise StopIteration()
+        rsid, genotype, chromo, position = next(self._items)
+
+        # Genotypes come back as interned strings, so there are few of them
+        geno = self._genotypes.get(genotype)
+        if geno is None:
+            geno = self._genotypes.setdefault(genotype,
+                    map(Nucleotide, genotype))
+
+        return SNP(list(geno), "rs%d" % rsid, self._orientation, chromo,
+                position)
 
 class Genome:
     """A genome consisting of SNPs."""
@@ -63,22 +71,45 @@ class Genome:
                 except ValueError:
                     raise ValueError("Invalid RSID: %s" % rsid)
             elif rsid.lower().startswith("i"):
-                raise NotImplementedError(
-                        "Internal IDs are not yet supported")
+                raise ValueError("Internal ID is not an RSID: %s" % rsid)
         else:
             raise ValueError("Invalid RSID: %s" % rsid)
 
+    def _internal_id(self, key):
+        """Converts a 23andMe internal ID like "i3000001" to integer, or
+        returns None if key isn't one."""
+        if isinstance(key, str) and key.lower().startswith("i"):
+            try:
+                return int(key[1:])
+            except ValueError:
+                raise ValueError("Invalid internal ID: %s" % key)
+        return None
+
     def __iter__(self):
         return GenomeIterator(self)
 
-    def intersect_rsid(self, genome):
+    def iteritems(self):
+        """Iterates over (rsid, genotype, chromosome, position) tuples, sorted
+        by integer RSID. Much faster than iterating over SNP objects."""
+        return self._genome.items()
+
+    def intersect_rsid(self, genome, threads=1):
         """Find RSIDs that exist in both genomes.
 
+        Arguments:
+            threads: Number of threads to use when both genomes are fully
+                sorted. Zero means one per CPU.
+
         Returns:
-            A list of RSID integers.
+            A sorted list of RSID integers.
         """
         assert(isinstance(genome, Genome))
-        return sorted(self._genome.intersect_rsid(genome._genome))
+        return self._genome.intersect_rsid(genome._genome, threads)
+
+    def intersect_rsid_count(self, genome, threads=1):
+        """Like intersect_rsid(), but only returns how many there are."""
+        assert(isinstance(genome, Genome))
+        return self._genome.intersect_rsid_count(genome._genome, threads)
 
     @property
     def ethnicity(self):
@@ -109,14 +140,57 @@ class Genome:
         """Returns all RSIDs in this genome."""
         return sorted(self._genome.rsids())
 
-    def intersect_snp(self, genome):
+    def columns(self):
+        """Returns the SNPs as columns, sorted by integer RSID, without
+        creating an object per SNP.
+
+        Returns:
+            A dict with "rsid", "chromosome", "position" and "genotype"
+            columns. Each supports len(), indexing and the buffer interface,
+            so it can be wrapped without copying, e.g. with
+            numpy.frombuffer(columns["rsid"], dtype=numpy.uint32).
+
+            RSIDs and positions are 32-bit unsigned ints. Chromosomes and
+            genotypes are unsigned bytes, which CHROMOSOME_CODES and
+            GENOTYPE_CODES turn into the values SNPs have. Genotype codes
+            don't keep the order of the alleles, so GA comes back as AG.
+        """
+        rsids, chromosomes, positions, genotypes = self._genome.columns()
+        return {"rsid": rsids,
+                "chromosome": chromosomes,
+                "position": positions,
+                "genotype": genotypes}
+
+    def intersect_snp(self, genome, threads=1):
         """Find RSID of SNPs that are equal in both genomes.
 
+        Arguments:
+            threads: As for intersect_rsid().
+
         Returns:
-            A list of RSID integers.
+            A sorted list of RSID integers.
         """
         assert(isinstance(genome, Genome))
-        return sorted(self._genome.intersect_snp(genome._genome))
+        return self._genome.intersect_snp(genome._genome, threads)
+
+    def intersect_snp_count(self, genome, threads=1):
+        """Like intersect_snp(), but only returns how many there are."""
+        assert(isinstance(genome, Genome))
+        return self._genome.intersect_snp_count(genome._genome, threads)
+
+    @property
+    def internal_ids(self):
+        """Returns all 23andMe internal IDs in this genome, as integers."""
+        return sorted(self._genome.internal_ids())
+
+    def intersect_internal(self, genome):
+        """Find internal IDs that exist in both genomes.
+
+        Returns:
+            A sorted list of internal ID integers.
+        """
+        assert(isinstance(genome, Genome))
+        return self._genome.intersect_internal(genome._genome)
 
     @property
     def first(self):
@@ -155,12 +229,30 @@ class Genome:
         if isinstance(key, int):
             return self.snp(key)
         if isinstance(key, str):
+            internal_id = self._internal_id(key)
+            if internal_id is not None:
+                return self.internal_snp(internal_id)
             return self.snp(self._rsid(key))
         elif isinstance(key, slice):
             return [self[i] for i in xrange(*key.indices(len(self)))]
         else:
             raise ValueError("Unknown key type %s" % type(key))
 
+    def find(self, chromosome, start=0, end=None):
+        """Returns the SNPs on a chromosome, ordered by position. The search
+        is done in C++, and can be limited to positions from start up to,
+        but not including, end.
+
+        Arguments:
+            chromosome: 1 to 22, or "MT", "X" or "Y".
+        """
+        args = (chromosome, start) if end is None else (chromosome, start,
+                end)
+        return [_to_snp("rs%d" % rsid, self._orientation,
+                    (map(Nucleotide, genotype), chromo, position))
+                for rsid, (genotype, chromo, position) in
+                self._genome.find(*args)]
+
     def snp(self, rsid):
         """Returns SNP with given integer-only RSID."""
         try:
@@ -171,9 +263,38 @@ class Genome:
         except KeyError:
             return SNP([], "rs%d" % rsid, self._orientation, 0, 0)
 
+    def get_many(self, rsids):
+        """Returns the SNPs with the given RSIDs, like self[rsid] for each of
+        them, but looked up in a single call. Much faster for more than a
+        few RSIDs."""
+        ids = [self._rsid(rsid) for rsid in rsids]
+        snps = []
+        for rsid, value in zip(ids, self._genome.get_many(ids)):
+            if value is None:
+                snps.append(SNP([], "rs%d" % rsid, self._orientation, 0, 0))
+            else:
+                genotype, chromo, position = value
+                snps.append(_to_snp("rs%d" % rsid, self._orientation,
+                    (map(Nucleotide, genotype), chromo, position)))
+        return snps
+
+    def internal_snp(self, internal_id):
+        """Returns SNP with given integer-only 23andMe internal ID."""
+        try:
+            genotype, chromo, position = self._genome.internal(internal_id)
+            geno = map(Nucleotide, genotype)
+            return _to_snp("i%d" % internal_id, self._orientation, (geno,
+                chromo, position))
+        except KeyError:
+            return SNP([], "i%d" % internal_id, self._orientation, 0, 0)
+
     def __contains__(self, rsid):
         try:
-            self._genome[self._rsid(rsid)]
+            internal_id = self._internal_id(rsid)
+            if internal_id is not None:
+                self._genome.internal(internal_id)
+            else:
+                self._genome[self._rsid(rsid)]
             return True
         except KeyError:
             return False
@@ -193,6 +314,18 @@ class Genome:
         raise AttributeError("'Genome' object has no attribute %s" %
                 repr(attr))
 
+    def save(self, filename):
+        """Writes the SNPs to a binary snapshot file, which can be read back
+        with dna_traits.load()."""
+        self._genome.save(filename)
+
+    def publish(self, name):
+        """Publishes the SNPs in POSIX shared memory under the given name,
+        such as "/genome", so other processes can get them with
+        dna_traits.attach() without parsing or copying. Remove it with
+        dna_traits.unpublish()."""
+        self._genome.publish(name)
+
     def __len__(self):
         """Returns number of SNPs in this genome."""
         return len(self._genome)
@@ -252,8 +252,9 @@ def hypothyroidism(genome):
     lo = sum(map(lambda l: min(l.values()), scores.values()))
 
     score = 0.0
-    for rsid, genotypes in scores.items():
-        score += unphased_match(genome[rsid], genotypes)
+    rsids = scores.keys()
+    for rsid, snp in zip(rsids, genome.get_many(rsids)):
+        score += unphased_match(snp, scores[rsid])
 
     if score > 0:
         s = "About %.1f%% higher risk than baseline\n" % (100.0*score/hi)
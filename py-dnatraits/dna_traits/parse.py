@@ -8,13 +8,125 @@ Distributed under the GPL v3 or later. See COPYING.
 import _dna_traits
 from genome import Genome
 
-def parse(filename, orientation=+1, year=None, ethnicity=None):
-    """Parses 23andMe text file and returns a Genome.
+ADVISE_SEQUENTIAL = _dna_traits.ADVISE_SEQUENTIAL
+ADVISE_WILLNEED = _dna_traits.ADVISE_WILLNEED
+ADVISE_POPULATE = _dna_traits.ADVISE_POPULATE
+ADVISE_HUGEPAGES = _dna_traits.ADVISE_HUGEPAGES
+
+STORAGE_HASH = _dna_traits.STORAGE_HASH
+STORAGE_SORTED = _dna_traits.STORAGE_SORTED
+
+CHROMOSOME_CODES = _dna_traits.CHROMOSOME_CODES
+GENOTYPE_CODES = _dna_traits.GENOTYPE_CODES
+
+def parse(filename, orientation=+1, year=None, ethnicity=None, threads=1,
+        errors=None, advice=0, storage=STORAGE_HASH):
+    """Parses 23andMe text file, which may be gzipped or zipped, and returns
+    a Genome.
+
+    Arguments:
+        orientation: Whether genotype is minus (-1) or plus (+1).
+        year: Year of birth for individual (optional).
+        ethnicity: Ethnicity for individial (optional).
+        threads: Number of threads to parse with, zero for one per CPU.
+        errors: If a list is given, each record is validated. Bad ones are
+            skipped, and (line, reason) tuples appended to the list.
+        advice: ADVISE_* flags or'ed together, telling the kernel how the
+            file will be read. ADVISE_SEQUENTIAL suits single threaded
+            parsing, while ADVISE_POPULATE faults in the whole file first.
+        storage: STORAGE_HASH for the fastest lookups, or STORAGE_SORTED to
+            use a fraction of the memory and iterate in RSID order.
+    """
+    return Genome(_dna_traits.parse(filename, threads, errors, advice,
+        storage), orientation, year=year, ethnicity=ethnicity)
+
+def prefetch(filenames):
+    """Starts reading the given files into the page cache in the
+    background, so parsing them later won't wait on the disk."""
+    for filename in filenames:
+        _dna_traits.prefetch(filename)
+
+def parse_files(filenames, lookahead=4, **kwargs):
+    """Parses each of the given files in turn, yielding Genomes. While one
+    file is parsed, the next lookahead files are read in the background.
+
+    Other keyword arguments are passed on to parse().
+    """
+    filenames = list(filenames)
+    prefetch(filenames[:lookahead])
+    for index, filename in enumerate(filenames):
+        prefetch(filenames[index+lookahead:index+lookahead+1])
+        yield parse(filename, **kwargs)
+
+def parse_buffer(data, orientation=+1, year=None, ethnicity=None, threads=1,
+        errors=None, storage=STORAGE_HASH):
+    """Parses 23andMe data held in memory and returns a Genome.
+
+    The data can be a str, bytearray, memoryview or any other object
+    supporting the buffer protocol, and is parsed in place.
 
     Arguments:
         orientation: Whether genotype is minus (-1) or plus (+1).
         year: Year of birth for individual (optional).
         ethnicity: Ethnicity for individial (optional).
+        threads: Number of threads to parse with, zero for one per CPU.
+        errors: A list to validate into, as for parse().
+        storage: How to keep the SNPs, as for parse().
     """
-    return Genome(_dna_traits.parse(filename), orientation, year=year,
-            ethnicity=ethnicity)
+    return Genome(_dna_traits.parse_buffer(data, threads, errors, storage),
+            orientation, year=year, ethnicity=ethnicity)
+
+def parse_stream(stream, orientation=+1, year=None, ethnicity=None,
+        errors=None, storage=STORAGE_HASH, threads=1):
+    """Parses 23andMe data read from a file object or descriptor, such as
+    sys.stdin or a pipe, and returns a Genome. The data may be gzipped or
+    zipped.
+
+    Arguments:
+        orientation: Whether genotype is minus (-1) or plus (+1).
+        year: Year of birth for individual (optional).
+        ethnicity: Ethnicity for individial (optional).
+        errors: A list to validate into, as for parse().
+        storage: How to keep the SNPs, as for parse().
+        threads: Number of threads to parse with, as for parse().
+    """
+    fd = stream if isinstance(stream, int) else stream.fileno()
+    return Genome(_dna_traits.parse_stream(fd, threads, errors, storage),
+            orientation, year=year, ethnicity=ethnicity)
+
+def load(filename, orientation=+1, year=None, ethnicity=None, verify=False):
+    """Loads a Genome from a snapshot file written by Genome.save().
+
+    Loading memory maps the file, and is much faster than parsing the
+    original text file.
+
+    Arguments:
+        orientation: Whether genotype is minus (-1) or plus (+1).
+        year: Year of birth for individual (optional).
+        ethnicity: Ethnicity for individial (optional).
+        verify: Verify the checksum of the whole file.
+    """
+    genome = _dna_traits.new_genome()
+    genome.load(filename, verify)
+    return Genome(genome, orientation, year=year, ethnicity=ethnicity)
+
+def attach(name, orientation=+1, year=None, ethnicity=None, verify=False):
+    """Returns a Genome published in shared memory by Genome.publish().
+
+    The shared pages are mapped read-only and used in place, so every process
+    that attaches shares the same memory, and attaching takes no time.
+
+    Arguments:
+        orientation: Whether genotype is minus (-1) or plus (+1).
+        year: Year of birth for individual (optional).
+        ethnicity: Ethnicity for individial (optional).
+        verify: Verify the checksum of the whole genome.
+    """
+    genome = _dna_traits.new_genome()
+    genome.attach(name, verify)
+    return Genome(genome, orientation, year=year, ethnicity=ethnicity)
+
+def unpublish(name):
+    """Removes a genome published in shared memory. Processes that have
+    attached to it can keep using it. Returns False if there was none."""
+    return _dna_traits.unpublish(name)
@@ -0,0 +1,66 @@
+"""
+Genotype rules, compiled and evaluated natively.
+
+Copyright (C) 2014, 2016 Christian Stigen Larsen
+Distributed under the GPL v3 or later. See COPYING.
+"""
+
+import _dna_traits
+
+class RuleSet:
+    """A set of named genotype rules, compiled once and evaluated against
+    any number of genomes. Each RSID is looked up once per genome, so a
+    whole report takes about as long as a handful of lookups.
+
+    Rules are written one per line, as a name and a colon followed by
+    predicates joined with & (and) and | (or), where & binds tighter:
+
+        # Blue eyes, see http://snpedia.com/index.php/Gs237/criteria
+        gs237: rs4778241 CC & rs12913832 GG & rs7495174 AA & rs8028689 TT
+               & rs7183877 CC & rs1800401 ~CC
+        sprinter: rs1815739 CC/CT
+
+    A predicate is an RSID and genotypes separated by slashes. The order of
+    the nucleotides doesn't matter, and ~ matches the complement. Lines
+    that don't start with a name continue the previous rule, and # starts a
+    comment. Genotypes are matched as they were read from the file.
+    """
+
+    def __init__(self, text=None):
+        self._rules = _dna_traits.RuleSet()
+        if text is not None:
+            self.add(text)
+
+    def add(self, text):
+        """Compiles and adds rules. Raises ValueError on syntax errors."""
+        self._rules.add(text)
+
+    def load(self, filename):
+        """Compiles and adds the rules in a file."""
+        self._rules.load(filename)
+
+    @property
+    def names(self):
+        """The rule names, in order."""
+        return self._rules.names()
+
+    @property
+    def rsids(self):
+        """The distinct RSIDs used by the rules, in sorted order."""
+        return self._rules.rsids()
+
+    def __len__(self):
+        return len(self._rules)
+
+    def evaluate(self, genome):
+        """Returns a dict of rule name to whether it holds for the
+        genome."""
+        return dict(zip(self.names, self._rules.evaluate(genome._genome)))
+
+    def evaluate_many(self, genomes, threads=1):
+        """Like evaluate, for each genome in a list, spread over the given
+        number of threads. Zero means one per CPU."""
+        names = self.names
+        results = self._rules.evaluate([g._genome for g in genomes],
+                threads)
+        return [dict(zip(names, r)) for r in results]
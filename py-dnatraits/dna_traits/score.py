@@ -0,0 +1,55 @@
+"""
+Polygenic scores, computed natively.
+
+Copyright (C) 2014, 2016 Christian Stigen Larsen
+Distributed under the GPL v3 or later. See COPYING.
+"""
+
+import _dna_traits
+
+class PolygenicScore:
+    """A polygenic score model, with a weight for each copy of a variant's
+    effect allele. It's compiled once, and can then score any number of
+    genomes.
+
+    A weights file has one variant per line, as whitespace separated
+    columns of RSID, effect allele, weight and, optionally, the other
+    allele. With the other allele given, genotypes read off the opposite
+    strand are complemented, and those with alleles that belong to neither
+    are left out. A first line that doesn't start with an RSID is a header,
+    and # starts a comment.
+    """
+
+    def __init__(self, filename=None):
+        self._model = _dna_traits.PolygenicScore()
+        if filename is not None:
+            self.load(filename)
+
+    def load(self, filename):
+        """Adds the variants in a weights file. Returns the number skipped
+        because their alleles aren't single nucleotides."""
+        return self._model.load(filename)
+
+    def add(self, rsid, effect, weight, other=None):
+        """Adds a variant. The RSID may be given as "rs123" or 123."""
+        if isinstance(rsid, str) and rsid.lower().startswith("rs"):
+            rsid = int(rsid[2:])
+        self._model.add(rsid, effect, weight, other)
+
+    @property
+    def rsids(self):
+        """The RSIDs of the variants, in the order they were added."""
+        return self._model.rsids()
+
+    def __len__(self):
+        return len(self._model)
+
+    def score(self, genome):
+        """Returns the sum of weights times effect alleles, and the number
+        of variants that had a usable call, as a tuple."""
+        return self._model.score(genome._genome)
+
+    def score_many(self, genomes, threads=1):
+        """Like score, for each genome in a list, spread over the given
+        number of threads. Zero means one per CPU."""
+        return self._model.score([g._genome for g in genomes], threads)
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <stdexcept>
+#include "columns.hpp"
+#include "genome.hpp"
+
+PySequenceMethods Column_seq = {
+  Column_length,
+  0, // concat
+  0, // repeat
+  Column_item,
+  0, // slice
+  0, // ass item
+  0, // ass slice
+  0, // contains
+  0, // inplace concat
+  0, // inplace repeat
+};
+
+/*
+ * The old buffer interface, used by numpy.frombuffer() and buffer().
+ */
+static Py_ssize_t Column_segcount(PyColumn* self, Py_ssize_t* lenp)
+{
+  if ( lenp != NULL )
+    *lenp = self->length * self->itemsize;
+  return 1;
+}
+
+static Py_ssize_t Column_readbuffer(PyColumn* self, Py_ssize_t segment,
+    void** ptr)
+{
+  if ( segment != 0 ) {
+    PyErr_SetString(PyExc_SystemError, "Accessing non-existent segment");
+    return -1;
+  }
+
+  *ptr = const_cast<char*>(self->data);
+  return self->length * self->itemsize;
+}
+
+/*
+ * The new buffer interface, used by memoryview and numpy.asarray().
+ */
+static int Column_getbuffer(PyColumn* self, Py_buffer* view, int flags)
+{
+  if ( PyBuffer_FillInfo(view, reinterpret_cast<PyObject*>(self),
+                         const_cast<char*>(self->data),
+                         self->length * self->itemsize, 1, flags) < 0 )
+    return -1;
+
+  view->itemsize = self->itemsize;
+  view->format = (flags & PyBUF_FORMAT)? const_cast<char*>(self->format) :
+                                         NULL;
+  view->shape = (flags & PyBUF_ND)? &self->length : NULL;
+  view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES?
+                  &self->itemsize : NULL;
+  return 0;
+}
+
+PyBufferProcs Column_buffer = {
+  (readbufferproc)Column_readbuffer,
+  0, // write buffer
+  (segcountproc)Column_segcount,
+  0, // char buffer
+  (getbufferproc)Column_getbuffer,
+  0, // release buffer
+};
+
+PyTypeObject ColumnType = {
+  PyObject_HEAD_INIT(NULL)
+  0, // obsize
+  "dna_traits.Column", // tpname
+  sizeof(PyColumn), // basicsize
+  0, // itemsize
+  (destructor)Column_dealloc, // dealloc
+  0, // print
+  0, // getattr
+  0, // setattr
+  0, // tpcompare
+  0, // tprepr
+  0, // tp as number
+  &Column_seq, // tp as seq
+  0, // tp as map
+  0, // tp hash
+  0, // tp call
+  0, // tp str
+  0, // tp getattro
+  0, // tp setattro
+  &Column_buffer, // tp as buff
+  Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, // tpflags
+  "A read-only column of genome data, with the buffer interface.", // docs
+  0, // traverse
+  0, // clear
+  0, // rich compare
+  0, // weaklistoffset
+  0, // iter
+  0, // iternext
+  0, // methods
+  0, // members
+  0, // getset
+  0, // base
+  0, // dict
+  0, // descr get
+  0, // descr set
+  0, // dictoffset
+  0, // init
+  0, // alloc
+  0, // tp new
+  NULL, // tp free
+  NULL, // tp_is_gc
+  NULL, // tp_bases
+  NULL, // tp_mro
+  NULL, // tp_cache
+  NULL, // tp_subclasses
+  NULL, // tp_weaklist
+  NULL, // tp_del
+  0, // tp_version_tag
+};
+
+void Column_dealloc(PyColumn* self)
+{
+  delete(self->owner);
+  PyObject_Del(self);
+}
+
+Py_ssize_t Column_length(PyObject* self)
+{
+  return reinterpret_cast<PyColumn*>(self)->length;
+}
+
+PyObject* Column_item(PyObject* self_, Py_ssize_t index)
+{
+  auto self = reinterpret_cast<PyColumn*>(self_);
+
+  if ( index < 0 || index >= self->length ) {
+    PyErr_SetString(PyExc_IndexError, "Column index out of range");
+    return NULL;
+  }
+
+  const char* p = self->data + index*self->itemsize;
+
+  if ( self->itemsize == 1 )
+    return PyInt_FromLong(*reinterpret_cast<const std::uint8_t*>(p));
+  else
+    return PyInt_FromLong(*reinterpret_cast<const std::uint32_t*>(p));
+}
+
+template<typename T>
+static PyObject* new_column(const std::shared_ptr<const GenomeColumns>& owner,
+    const std::vector<T>& values, const char* format)
+{
+  auto c = PyObject_New(PyColumn, &ColumnType);
+  if ( c == NULL )
+    return NULL;
+
+  c->owner = new std::shared_ptr<const GenomeColumns>(owner);
+  c->data = reinterpret_cast<const char*>(values.data());
+  c->format = format;
+  c->length = values.size();
+  c->itemsize = sizeof(T);
+  return reinterpret_cast<PyObject*>(c);
+}
+
+PyObject* new_columns(const Genome& genome)
+{
+  std::shared_ptr<const GenomeColumns> columns;
+
+  try {
+    columns = std::make_shared<const GenomeColumns>(genome.columns());
+  }
+  catch ( const std::exception& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+
+  static_assert(sizeof(RSID) == 4 && sizeof(Position) == 4,
+      "Columns are exported as 32-bit unsigned ints");
+
+  PyObject* items[4] = {
+    new_column(columns, columns->rsids, "I"),
+    new_column(columns, columns->chromosomes, "B"),
+    new_column(columns, columns->positions, "I"),
+    new_column(columns, columns->genotypes, "B"),
+  };
+
+  for ( auto item : items ) {
+    if ( item == NULL ) {
+      for ( auto other : items )
+        Py_XDECREF(other);
+      return NULL;
+    }
+  }
+
+  auto tuple = PyTuple_New(4);
+  for ( size_t n = 0; n < 4; ++n )
+    PyTuple_SetItem(tuple, n, items[n]);
+
+  return tuple;
+}
+
+PyObject* genotype_codes()
+{
+  auto tuple = PyTuple_New(32);
+
+  for ( unsigned code = 0; code < 32; ++code ) {
+    PackedSNP p;
+    p.bits = code;
+
+    // Unused codes have no genotype
+    if ( code != 0 && PackedSNP::code(p.genotype()) == code )
+      PyTuple_SetItem(tuple, code, genotype_to_pyobj(p.genotype()));
+    else
+      PyTuple_SetItem(tuple, code, PyString_FromString(""));
+  }
+
+  return tuple;
+}
+
+PyObject* chromosome_codes()
+{
+  auto tuple = PyTuple_New(CHR_Y + 1);
+
+  for ( int chr = NO_CHR; chr <= CHR_Y; ++chr )
+    PyTuple_SetItem(tuple, chr,
+        chromosome_to_pyobj(static_cast<Chromosome>(chr)));
+
+  return tuple;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef INC_DNATRAITS_COLUMNS_HPP_20160903
+#define INC_DNATRAITS_COLUMNS_HPP_20160903
+
+#include <Python.h>
+#include <structmember.h>
+#include <memory>
+#include "dnatraits.hpp"
+
+/*
+ * One column of a GenomeColumns, exported as a read-only, one-dimensional
+ * buffer. The columns of a genome share the GenomeColumns they point into.
+ */
+struct PyColumn {
+  PyObject_HEAD
+  std::shared_ptr<const GenomeColumns> *owner;
+  const char *data;
+  const char *format;
+  Py_ssize_t length;
+  Py_ssize_t itemsize;
+};
+
+PyObject* Column_item(PyObject*, Py_ssize_t);
+Py_ssize_t Column_length(PyObject*);
+extern PyBufferProcs Column_buffer;
+extern PySequenceMethods Column_seq;
+extern PyTypeObject ColumnType;
+void Column_dealloc(PyColumn* self);
+
+/*
+ * Returns a tuple of (rsids, chromosomes, positions, genotypes) columns.
+ */
+PyObject* new_columns(const Genome&);
+
+/*
+ * Returns a tuple with the genotype string of each genotype code.
+ */
+PyObject* genotype_codes();
+
+/*
+ * Returns a tuple with the chromosome of each chromosome code.
+ */
+PyObject* chromosome_codes();
+
+#endif
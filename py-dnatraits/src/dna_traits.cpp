@@ -4,26 +4,195 @@
  */
 
 #include <Python.h>
+#include "columns.hpp"
 #include "dnatraits.hpp"
 #include "genome.hpp"
+#include "rules.hpp"
+#include "score.hpp"
+
+/*
+ * Turns on validation if given a list to report errors to.
+ */
+static bool validate_into(PyObject* list, ParseOptions& options,
+    std::vector<ParseError>& errors)
+{
+  if ( list == NULL || list == Py_None )
+    return true;
+
+  if ( !PyList_Check(list) ) {
+    PyErr_SetString(PyExc_TypeError, "Errors must be a list");
+    return false;
+  }
+
+  options.errors = &errors;
+  return true;
+}
+
+/*
+ * Appends (line, reason) tuples to the list.
+ */
+static bool report_errors(PyObject* list,
+    const std::vector<ParseError>& errors)
+{
+  for ( const auto& e : errors ) {
+    auto item = Py_BuildValue("(ns)", static_cast<Py_ssize_t>(e.line),
+                              e.reason.c_str());
+    if ( item == NULL || PyList_Append(list, item) != 0 ) {
+      Py_XDECREF(item);
+      return false;
+    }
+    Py_DECREF(item);
+  }
+
+  return true;
+}
+
+/*
+ * Returns a new, empty Python Genome with the given storage.
+ */
+static PyObject* new_genome(const unsigned storage)
+{
+  auto pygenome = Genome_new(&GenomeType, NULL, NULL);
+
+  if ( pygenome != NULL && storage != STORAGE_HASH )
+    *reinterpret_cast<PyGenome*>(pygenome)->genome =
+      Genome(0, static_cast<Storage>(storage));
+
+  return pygenome;
+}
 
 static PyObject* parse(PyObject* /*module*/, PyObject* args)
 {
+  PyObject* pygenome = NULL;
+
   try {
     char *file = NULL;
-    if ( !PyArg_ParseTuple(args, "s", &file) )
+    unsigned threads = 1;
+    PyObject* list = NULL;
+    unsigned advice = ADVISE_NONE;
+    unsigned storage = STORAGE_HASH;
+    if ( !PyArg_ParseTuple(args, "s|IOII", &file, &threads, &list, &advice,
+                           &storage) )
+      return NULL;
+
+    ParseOptions options(threads);
+    options.advice = advice;
+    std::vector<ParseError> errors;
+    if ( !validate_into(list, options, errors) )
+      return NULL;
+
+    pygenome = new_genome(storage);
+    parse_file(file, *reinterpret_cast<PyGenome*>(pygenome)->genome,
+               options);
+
+    if ( !report_errors(list, errors) ) {
+      Py_DECREF(pygenome);
+      return NULL;
+    }
+
+    return pygenome;
+  }
+  catch ( const std::exception& e) {
+    Py_XDECREF(pygenome);
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
+
+static PyObject* parse_buffer(PyObject* /*module*/, PyObject* args)
+{
+  Py_buffer buffer;
+  unsigned threads = 1;
+  PyObject* list = NULL;
+  unsigned storage = STORAGE_HASH;
+  if ( !PyArg_ParseTuple(args, "s*|IOI", &buffer, &threads, &list,
+                         &storage) )
+    return NULL;
+
+  PyObject* pygenome = NULL;
+
+  try {
+    ParseOptions options(threads);
+    std::vector<ParseError> errors;
+    if ( !validate_into(list, options, errors) ) {
+      PyBuffer_Release(&buffer);
+      return NULL;
+    }
+
+    pygenome = new_genome(storage);
+    parse_buffer(static_cast<const char*>(buffer.buf), buffer.len,
+                 *reinterpret_cast<PyGenome*>(pygenome)->genome,
+                 options);
+    PyBuffer_Release(&buffer);
+
+    if ( !report_errors(list, errors) ) {
+      Py_DECREF(pygenome);
+      return NULL;
+    }
+
+    return pygenome;
+  }
+  catch ( const std::exception& e) {
+    Py_XDECREF(pygenome);
+    PyBuffer_Release(&buffer);
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
+
+static PyObject* parse_stream(PyObject* /*module*/, PyObject* args)
+{
+  PyObject* pygenome = NULL;
+
+  try {
+    int fd = -1;
+    PyObject* list = NULL;
+    unsigned storage = STORAGE_HASH;
+    unsigned threads = 1;
+    if ( !PyArg_ParseTuple(args, "i|IOI", &fd, &threads, &list, &storage) )
+      return NULL;
+
+    ParseOptions options(threads);
+    std::vector<ParseError> errors;
+    if ( !validate_into(list, options, errors) )
+      return NULL;
+
+    pygenome = new_genome(storage);
+    parse_stream(fd, *reinterpret_cast<PyGenome*>(pygenome)->genome,
+                 options);
+
+    if ( !report_errors(list, errors) ) {
+      Py_DECREF(pygenome);
       return NULL;
+    }
 
-    auto pygenome = Genome_new(&GenomeType, NULL, NULL);
-    parse_file(file, *reinterpret_cast<PyGenome*>(pygenome)->genome);
     return pygenome;
   }
   catch ( const std::exception& e) {
+    Py_XDECREF(pygenome);
     PyErr_SetString(PyExc_RuntimeError, e.what());
     return NULL;
   }
 }
 
+static PyObject* prefetch(PyObject* /*module*/, PyObject* args)
+{
+  char *file = NULL;
+  if ( !PyArg_ParseTuple(args, "s", &file) )
+    return NULL;
+
+  return PyBool_FromLong(prefetch_file(file));
+}
+
+static PyObject* unpublish(PyObject* /*module*/, PyObject* args)
+{
+  char *name = NULL;
+  if ( !PyArg_ParseTuple(args, "s", &name) )
+    return NULL;
+
+  return PyBool_FromLong(Genome::unpublish(name));
+}
+
 static PyObject* new_empty(PyObject* /*module*/, PyObject* /*args*/)
 {
   return Genome_new(&GenomeType, NULL, NULL);
@@ -31,7 +200,28 @@ static PyObject* new_empty(PyObject* /*module*/, PyObject* /*args*/)
 
 static PyMethodDef methods[] = {
   {"parse", parse, METH_VARARGS,
-   "Parses a 23andMe genome text file and returns a dict of RSID->GENOTYPE."},
+   "Parses a 23andMe genome text file and returns a dict of RSID->GENOTYPE.\n"
+   "An optional second argument gives the number of threads to use (zero\n"
+   "means one per CPU). If a list is given as the third, records are\n"
+   "validated, and (line, reason) is appended to it for bad ones. The\n"
+   "fourth is a bitwise or of ADVISE_* flags for mapping the file, and the\n"
+   "fifth is STORAGE_HASH or STORAGE_SORTED."},
+  {"parse_buffer", parse_buffer, METH_VARARGS,
+   "Parses 23andMe genome data held in a str, bytearray, memoryview or other\n"
+   "buffer object, without copying it. An optional second argument gives the\n"
+   "number of threads to use, the third a list to validate into, and the\n"
+   "fourth the storage."},
+  {"parse_stream", parse_stream, METH_VARARGS,
+   "Parses 23andMe genome data read from a file descriptor until end of\n"
+   "file. The data may be gzipped or zipped. An optional second argument\n"
+   "gives the number of threads to parse with, the third a list to\n"
+   "validate into, and the fourth the storage."},
+  {"prefetch", prefetch, METH_VARARGS,
+   "Starts reading a file into the page cache in the background. Returns\n"
+   "False if it couldn't be opened."},
+  {"unpublish", unpublish, METH_VARARGS,
+   "Removes a genome published in shared memory. Returns False if there\n"
+   "was none."},
   {"new_genome", new_empty, METH_VARARGS,
     "Returns a new, empty Genome."},
   {NULL, NULL, 0, NULL}
@@ -45,14 +235,42 @@ void init_dna_traits()
   if ( PyType_Ready(&GenomeType) < 0 )
     return;
 
+  if ( PyType_Ready(&GenomeIterType) < 0 )
+    return;
+
+  if ( PyType_Ready(&ColumnType) < 0 )
+    return;
+
+  if ( PyType_Ready(&RuleSetType) < 0 )
+    return;
+
+  if ( PyType_Ready(&PolygenicScoreType) < 0 )
+    return;
+
   auto module = Py_InitModule3("_dna_traits", methods,
                                "A fast parser for 23andMe genome files");
 
   #if (__GNUC__ == 4 && __GNUC_MINOR__ >= 3) || __GNUC__ > 4
   #pragma GCC diagnostic ignored "-Wstrict-aliasing"
   Py_INCREF(&GenomeType);
+  Py_INCREF(&RuleSetType);
+  Py_INCREF(&PolygenicScoreType);
   #endif
 
   PyModule_AddObject(module, "Genome",
                      reinterpret_cast<PyObject*>(&GenomeType));
+  PyModule_AddObject(module, "RuleSet",
+                     reinterpret_cast<PyObject*>(&RuleSetType));
+  PyModule_AddObject(module, "PolygenicScore",
+                     reinterpret_cast<PyObject*>(&PolygenicScoreType));
+
+  PyModule_AddIntConstant(module, "ADVISE_SEQUENTIAL", ADVISE_SEQUENTIAL);
+  PyModule_AddIntConstant(module, "ADVISE_WILLNEED", ADVISE_WILLNEED);
+  PyModule_AddIntConstant(module, "ADVISE_POPULATE", ADVISE_POPULATE);
+  PyModule_AddIntConstant(module, "ADVISE_HUGEPAGES", ADVISE_HUGEPAGES);
+  PyModule_AddIntConstant(module, "STORAGE_HASH", STORAGE_HASH);
+  PyModule_AddIntConstant(module, "STORAGE_SORTED", STORAGE_SORTED);
+
+  PyModule_AddObject(module, "GENOTYPE_CODES", genotype_codes());
+  PyModule_AddObject(module, "CHROMOSOME_CODES", chromosome_codes());
 }
@@ -4,6 +4,12 @@
  */
 
 #include <stdio.h>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include "columns.hpp"
 #include "genome.hpp"
 
 static char from_nucleotide(const Nucleotide& n)
@@ -20,34 +26,96 @@ static char from_nucleotide(const Nucleotide& n)
   return '?'; // appease compiler
 }
 
-static PyObject* snp_to_pyobj(const SNP& snp)
+/*
+ * Genotype strings are shared by all SNPs with the same genotype, so they
+ * aren't created over and over.
+ */
+PyObject* genotype_to_pyobj(const Genotype& g)
 {
-  assert(NO_CHR == 0); // due to comparison below
+  static PyObject* cache[7][7] = {{NULL}};
+  PyObject*& s = cache[g.first][g.second];
+
+  if ( s == NULL ) {
+    const char genotype[3] = {
+      from_nucleotide(g.first),
+      from_nucleotide(g.second),
+      0};
+    s = PyString_InternFromString(genotype);
+  }
 
-  auto tuple = PyTuple_New(3);
-  const char genotype[3] = {
-    from_nucleotide(snp.genotype.first),
-    from_nucleotide(snp.genotype.second),
-    0};
-
-  PyObject* pchromo = NULL;
-  if ( snp.chromosome < CHR_MT ) {
-    pchromo = Py_BuildValue("I", snp.chromosome);
-  } else {
-    switch ( snp.chromosome ) {
-      case CHR_MT: pchromo = Py_BuildValue("s", "MT"); break;
-      case CHR_X:  pchromo = Py_BuildValue("s", "X");  break;
-      case CHR_Y:  pchromo = Py_BuildValue("s", "Y");  break;
-      default: break;
+  Py_XINCREF(s);
+  return s;
+}
+
+/*
+ * Chromosomes are 1-22 as ints, or "MT", "X" or "Y", and are shared too.
+ */
+PyObject* chromosome_to_pyobj(const Chromosome chromosome)
+{
+  static PyObject* cache[CHR_Y + 1] = {NULL};
+
+  if ( chromosome > CHR_Y )
+    Py_RETURN_NONE;
+
+  PyObject*& o = cache[chromosome];
+
+  if ( o == NULL ) {
+    switch ( chromosome ) {
+      case CHR_MT: o = PyString_InternFromString("MT"); break;
+      case CHR_X:  o = PyString_InternFromString("X");  break;
+      case CHR_Y:  o = PyString_InternFromString("Y");  break;
+      default:     o = PyInt_FromLong(chromosome);     break;
     }
   }
 
-  PyTuple_SetItem(tuple, 0, Py_BuildValue("s", genotype));
-  PyTuple_SetItem(tuple, 1, pchromo);
-  PyTuple_SetItem(tuple, 2, Py_BuildValue("I", snp.position));
+  Py_XINCREF(o);
+  return o;
+}
+
+static PyObject* snp_to_pyobj(const SNP& snp)
+{
+  auto tuple = PyTuple_New(3);
+  PyTuple_SetItem(tuple, 0, genotype_to_pyobj(snp.genotype));
+  PyTuple_SetItem(tuple, 1, chromosome_to_pyobj(snp.chromosome));
+  PyTuple_SetItem(tuple, 2, PyInt_FromLong(snp.position));
   return tuple;
 }
 
+/*
+ * Accepts 1-22, or "1"-"22", "MT", "X" and "Y".
+ */
+static bool pyobj_to_chromosome(PyObject* o, Chromosome& chr)
+{
+  long n = 0;
+
+  if ( PyInt_Check(o) ) {
+    n = PyInt_AsLong(o);
+  } else if ( PyString_Check(o) ) {
+    const std::string s(PyString_AsString(o));
+
+    if ( s == "MT" ) {
+      chr = CHR_MT;
+      return true;
+    } else if ( s == "X" ) {
+      chr = CHR_X;
+      return true;
+    } else if ( s == "Y" ) {
+      chr = CHR_Y;
+      return true;
+    }
+
+    n = std::strtol(s.c_str(), NULL, 10);
+  }
+
+  if ( n < CHR1 || n > CHR22 ) {
+    PyErr_SetString(PyExc_ValueError, "Unknown chromosome.");
+    return false;
+  }
+
+  chr = static_cast<Chromosome>(n);
+  return true;
+}
+
 PyMemberDef Genome_members[] = {
   {NULL, 0, 0, 0, NULL}
 };
@@ -69,14 +137,53 @@ PyMethodDef Genome_methods[] = {
     "Returns last RSID."},
   {"eq", (PyCFunction)Genome_eq, METH_O,
     "Checks for equality"},
-  {"intersect_rsid", (PyCFunction)Genome_intersect_rsid, METH_O,
-    "Returns list of common RSIDs."},
-  {"intersect_snp", (PyCFunction)Genome_intersect_snp, METH_O,
-    "Returns list of common SNPs."},
+  {"intersect_rsid", (PyCFunction)Genome_intersect_rsid, METH_VARARGS,
+    "Returns list of common RSIDs. An optional second argument gives the\n"
+    "number of threads to use when both genomes are sorted."},
+  {"intersect_snp", (PyCFunction)Genome_intersect_snp, METH_VARARGS,
+    "Returns list of common SNPs, with threads as for intersect_rsid."},
+  {"intersect_rsid_count", (PyCFunction)Genome_intersect_rsid_count,
+    METH_VARARGS, "Like intersect_rsid, but returns only the count."},
+  {"intersect_snp_count", (PyCFunction)Genome_intersect_snp_count,
+    METH_VARARGS, "Like intersect_snp, but returns only the count."},
+  {"internal", (PyCFunction)Genome_internal, METH_O,
+    "Returns SNP with given 23andMe internal ID, as an integer."},
+  {"internal_ids", (PyCFunction)Genome_internal_ids, METH_NOARGS,
+    "Returns all internal IDs in this genome."},
+  {"internal_size", (PyCFunction)Genome_internal_size, METH_NOARGS,
+    "Returns number of SNPs with internal IDs."},
+  {"intersect_internal", (PyCFunction)Genome_intersect_internal, METH_O,
+    "Returns list of common internal IDs."},
+  {"get_many", (PyCFunction)Genome_get_many, METH_O,
+    "Looks up a list of integer RSIDs in one go. Returns a list of SNPs,\n"
+    "with None for those that are missing."},
+  {"find", (PyCFunction)Genome_find, METH_VARARGS,
+    "Returns list of (RSID, SNP) on a chromosome, optionally only those\n"
+    "with positions from the second argument up to, but not including,\n"
+    "the third."},
   {"rsids", (PyCFunction)Genome_rsids, METH_NOARGS,
     "Returns list of all RSIDs in this genome."},
+  {"items", (PyCFunction)Genome_items, METH_NOARGS,
+    "Returns an iterator over (rsid, genotype, chromosome, position) for\n"
+    "all SNPs, sorted by RSID. Iterating over the genome itself gives the\n"
+    "same, in the order the SNPs are stored, which is faster."},
   {"snps", (PyCFunction)Genome_snps, METH_NOARGS,
     "Returns all SNPs in this genome."},
+  {"columns", (PyCFunction)Genome_columns, METH_NOARGS,
+    "Returns the SNPs as a tuple of (rsids, chromosomes, positions,\n"
+    "genotypes) columns, sorted by RSID. Each is a read-only buffer of\n"
+    "unsigned ints, or bytes for the chromosome and genotype codes."},
+  {"save", (PyCFunction)Genome_save, METH_VARARGS,
+    "Writes genome to a binary snapshot file."},
+  {"load", (PyCFunction)Genome_load, METH_VARARGS,
+    "Replaces genome with contents of a snapshot file. If the optional\n"
+    "second argument is True, the file's checksum is verified."},
+  {"publish", (PyCFunction)Genome_publish, METH_VARARGS,
+    "Publishes genome as a snapshot in named POSIX shared memory."},
+  {"attach", (PyCFunction)Genome_attach, METH_VARARGS,
+    "Replaces genome with one published in named shared memory, mapped\n"
+    "read-only. If the optional second argument is True, the checksum is\n"
+    "verified."},
   {NULL, NULL, 0, NULL}
 };
 
@@ -108,7 +215,7 @@ PyTypeObject GenomeType = {
   0, // clear
   0, // rich compare
   0, // weaklistoffset
-  0, // iter
+  Genome_iter, // iter
   0, // iternext
   Genome_methods, // methods
   Genome_members, // members
@@ -132,6 +239,166 @@ PyTypeObject GenomeType = {
   0, // tp_version_tag
 };
 
+PyTypeObject GenomeIterType = {
+  PyObject_HEAD_INIT(NULL)
+  0, // obsize
+  "dna_traits.GenomeIter", // tpname
+  sizeof(PyGenomeIter), // basicsize
+  0, // itemsize
+  (destructor)GenomeIter_dealloc, // dealloc
+  0, // print
+  0, // getattr
+  0, // setattr
+  0, // tpcompare
+  0, // tprepr
+  0, // tp as number
+  0, // tp as seq
+  0, // tp as map
+  0, // tp hash
+  0, // tp call
+  0, // tp str
+  0, // tp getattro
+  0, // tp setattro
+  0, // tp as buff
+  Py_TPFLAGS_DEFAULT, // tpflags
+  "Iterator over (rsid, genotype, chromosome, position) tuples.", // docs
+  0, // traverse
+  0, // clear
+  0, // rich compare
+  0, // weaklistoffset
+  PyObject_SelfIter, // iter
+  (iternextfunc)GenomeIter_next, // iternext
+  0, // methods
+  0, // members
+  0, // getset
+  0, // base
+  0, // dict
+  0, // descr get
+  0, // descr set
+  0, // dictoffset
+  0, // init
+  0, // alloc
+  0, // tp new
+  NULL, // tp free
+  NULL, // tp_is_gc
+  NULL, // tp_bases
+  NULL, // tp_mro
+  NULL, // tp_cache
+  NULL, // tp_subclasses
+  NULL, // tp_weaklist
+  NULL, // tp_del
+  0, // tp_version_tag
+};
+
+/*
+ * Returns an iterator over the genome, which it keeps alive. If sorted,
+ * the RSIDs are collected and sorted up front, and looked up one by one.
+ * Otherwise, the genome's own iterator is used, and nothing is copied.
+ */
+static PyObject* new_iterator(PyGenome* genome, const bool sorted)
+{
+  auto it = PyObject_New(PyGenomeIter, &GenomeIterType);
+  if ( it == NULL )
+    return NULL;
+
+  Py_INCREF(genome);
+  it->genome = genome;
+  it->version = genome->version;
+  it->current = NULL;
+  it->end = NULL;
+  it->order = NULL;
+  it->index = 0;
+  it->item = NULL;
+
+  try {
+    if ( sorted ) {
+      it->order = new std::vector<RSID>(genome->genome->rsids());
+      std::sort(it->order->begin(), it->order->end());
+    } else {
+      it->current = new GenomeIterator(genome->genome->begin());
+      it->end = new GenomeIterator(genome->genome->end());
+    }
+  }
+  catch ( const std::exception& e ) {
+    Py_DECREF(it);
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+
+  return reinterpret_cast<PyObject*>(it);
+}
+
+PyObject* Genome_iter(PyObject* self)
+{
+  return new_iterator(reinterpret_cast<PyGenome*>(self), false);
+}
+
+PyObject* Genome_items(PyGenome* self)
+{
+  return new_iterator(self, true);
+}
+
+void GenomeIter_dealloc(PyGenomeIter* self)
+{
+  delete self->current;
+  delete self->end;
+  delete self->order;
+  Py_XDECREF(self->item);
+  Py_XDECREF(self->genome);
+  PyObject_Del(self);
+}
+
+PyObject* GenomeIter_next(PyGenomeIter* self)
+{
+  if ( self->genome->version != self->version ) {
+    PyErr_SetString(PyExc_RuntimeError, "Genome changed during iteration.");
+    return NULL;
+  }
+
+  RSID rsid;
+  const SNP* snp;
+
+  if ( self->order != NULL ) {
+    if ( self->index == self->order->size() )
+      return NULL;
+    rsid = (*self->order)[self->index++];
+    snp = &(*self->genome->genome)[rsid];
+  } else {
+    if ( *self->current == *self->end )
+      return NULL;
+    const RsidSNP& p = **self->current;
+    rsid = p.rsid;
+    snp = &p.snp;
+  }
+
+  // Like dict.iteritems(), reuse the last tuple if only we hold it
+  auto item = self->item;
+  if ( item != NULL && Py_REFCNT(item) == 1 ) {
+    Py_INCREF(item);
+    for ( Py_ssize_t n = 0; n < 4; ++n )
+      Py_DECREF(PyTuple_GET_ITEM(item, n));
+  } else {
+    Py_XDECREF(item);
+    item = PyTuple_New(4);
+    if ( item == NULL ) {
+      self->item = NULL;
+      return NULL;
+    }
+    self->item = item;
+    Py_INCREF(item);
+  }
+
+  PyTuple_SET_ITEM(item, 0, PyInt_FromLong(rsid));
+  PyTuple_SET_ITEM(item, 1, genotype_to_pyobj(snp->genotype));
+  PyTuple_SET_ITEM(item, 2, chromosome_to_pyobj(snp->chromosome));
+  PyTuple_SET_ITEM(item, 3, PyInt_FromLong(snp->position));
+
+  if ( self->order == NULL )
+    ++*self->current;
+
+  return item;
+}
+
 void Genome_dealloc(PyGenome* self)
 {
   delete(self->genome);
@@ -144,8 +411,10 @@ PyObject* Genome_new(PyTypeObject* type,
 {
   auto p = reinterpret_cast<PyGenome*>(type->tp_alloc(type, 0));
 
-  if ( p != NULL )
-    p->genome = new Genome(1e6);
+  if ( p != NULL ) {
+    p->genome = new Genome();
+    p->version = 0;
+  }
 
   return reinterpret_cast<PyObject*>(p);
 }
@@ -158,7 +427,7 @@ int Genome_init(PyGenome*, PyObject*, PyObject*)
 
 PyObject* Genome_y_chromosome(PyGenome* self)
 {
-  return self->genome->y_chromosome? Py_True : Py_False;
+  return PyBool_FromLong(self->genome->y_chromosome);
 }
 
 PyObject* Genome_first(PyGenome* self)
@@ -199,15 +468,113 @@ PyObject* Genome_getitem(PyObject* self, PyObject* rsid_)
   }
 
   auto genome = reinterpret_cast<PyGenome*>(self);
+  const SNP& snp = genome->genome->operator[](rsid);
 
-  if ( !genome->genome->has(rsid) ) {
+  // Missing RSIDs give NONE_SNP itself, which saves a second lookup
+  if ( &snp == &NONE_SNP ) {
     char err[32];
     sprintf(err, "rs%u", rsid);
     PyErr_SetString(PyExc_KeyError, err);
     return NULL;
   } else {
-    return snp_to_pyobj(genome->genome->operator[](rsid));
+    return snp_to_pyobj(snp);
+  }
+}
+
+/*
+ * Returns an int or long as an RSID, or -1 if it's something else or out of
+ * range.
+ */
+static long rsid_from_pyobj(PyObject* item)
+{
+  long rsid = -1;
+
+  if ( PyInt_Check(item) )
+    rsid = PyInt_AsLong(item);
+  else if ( PyLong_Check(item) ) {
+    rsid = PyLong_AsLong(item);
+    if ( rsid == -1 && PyErr_Occurred() )
+      PyErr_Clear(); // overflow
+  }
+
+  return rsid > 0xffffffffL? -1 : rsid;
+}
+
+PyObject* Genome_get_many(PyGenome* self, PyObject* rsids_)
+{
+  auto seq = PySequence_Fast(rsids_, "RSIDs must be a sequence.");
+  if ( seq == NULL )
+    return NULL;
+
+  try {
+    const Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    std::vector<RSID> rsids(count);
+
+    for ( Py_ssize_t n = 0; n < count; ++n ) {
+      const long rsid = rsid_from_pyobj(PySequence_Fast_GET_ITEM(seq, n));
+
+      if ( rsid < 0 ) {
+        Py_DECREF(seq);
+        PyErr_SetString(PyExc_ValueError,
+                        "RSIDs must be non-negative 32-bit integers.");
+        return NULL;
+      }
+
+      rsids[n] = static_cast<RSID>(rsid);
+    }
+
+    Py_CLEAR(seq);
+
+    std::vector<SNP> snps(count);
+    std::unique_ptr<bool[]> found(new bool[count]);
+    self->genome->lookup(rsids.data(), count, snps.data(), found.get());
+
+    auto list = PyList_New(count);
+    if ( list == NULL )
+      return NULL;
+
+    for ( Py_ssize_t n = 0; n < count; ++n ) {
+      if ( found[n] ) {
+        PyList_SetItem(list, n, snp_to_pyobj(snps[n]));
+      } else {
+        Py_INCREF(Py_None);
+        PyList_SetItem(list, n, Py_None);
+      }
+    }
+
+    return list;
+  }
+  catch ( const std::exception& e ) {
+    Py_XDECREF(seq);
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
+
+PyObject* Genome_internal(PyGenome* self, PyObject* id_)
+{
+  if ( !PyInt_Check(id_) ) {
+    PyErr_SetString(PyExc_ValueError, "Internal ID not a number.");
+    return NULL;
+  }
+
+  const size_t id_sizet = PyInt_AsSsize_t(id_);
+  const uint32_t id = static_cast<uint32_t>(id_sizet);
+
+  if ( id_sizet > id || !self->genome->has_internal(id) ) {
+    char err[32];
+    sprintf(err, "i%zu", id_sizet);
+    PyErr_SetString(PyExc_KeyError, err);
+    return NULL;
   }
+
+  return snp_to_pyobj(self->genome->internal(id));
+}
+
+PyObject* Genome_internal_size(PyGenome* self)
+{
+  return Py_BuildValue("n",
+      static_cast<Py_ssize_t>(self->genome->internal_size()));
 }
 
 PyObject* Genome_eq(PyGenome* self, PyObject* other)
@@ -219,29 +586,72 @@ PyObject* Genome_eq(PyGenome* self, PyObject* other)
   }
 
   auto right = reinterpret_cast<PyGenome*>(other);
-  return self->genome->operator==(*right->genome)? Py_True : Py_False;
+  return PyBool_FromLong(self->genome->operator==(*right->genome));
 }
 
-PyObject* Genome_intersect_rsid(PyGenome* self, PyObject* other)
+/*
+ * Parses (genome[, threads]) and calls f(other, threads), turning C++
+ * exceptions into Python ones.
+ */
+template<class F>
+static PyObject* intersect(PyObject* args, F f)
 {
-  if ( !PyObject_TypeCheck(other, &GenomeType) ) {
-    PyErr_SetString(PyExc_TypeError,
-                    "Expected type dna_traits.Genome");
+  PyObject* other = NULL;
+  unsigned threads = 1;
+
+  if ( !PyArg_ParseTuple(args, "O!|I", &GenomeType, &other, &threads) )
     return NULL;
-  }
 
-  const auto right = reinterpret_cast<PyGenome*>(other);
-  auto rsids = self->genome->intersect_rsid(*right->genome);
+  try {
+    return f(*reinterpret_cast<PyGenome*>(other)->genome, threads);
+  }
+  catch ( const std::exception& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
 
+static PyObject* rsid_list(const std::vector<RSID>& rsids)
+{
   auto list = PyList_New(rsids.size());
   size_t n=0;
-  for ( auto rsid : rsids )
+  for ( const auto& rsid : rsids )
     PyList_SetItem(list, n++, Py_BuildValue("I", rsid));
 
   return list;
 }
 
-PyObject* Genome_intersect_snp(PyGenome* self, PyObject* other)
+PyObject* Genome_intersect_rsid(PyGenome* self, PyObject* args)
+{
+  return intersect(args, [&](const Genome& other, unsigned threads) {
+    return rsid_list(self->genome->intersect_rsid(other, threads));
+  });
+}
+
+PyObject* Genome_intersect_snp(PyGenome* self, PyObject* args)
+{
+  return intersect(args, [&](const Genome& other, unsigned threads) {
+    return rsid_list(self->genome->intersect_snp(other, threads));
+  });
+}
+
+PyObject* Genome_intersect_rsid_count(PyGenome* self, PyObject* args)
+{
+  return intersect(args, [&](const Genome& other, unsigned threads) {
+    return Py_BuildValue("n", static_cast<Py_ssize_t>(
+          self->genome->intersect_rsid_count(other, threads)));
+  });
+}
+
+PyObject* Genome_intersect_snp_count(PyGenome* self, PyObject* args)
+{
+  return intersect(args, [&](const Genome& other, unsigned threads) {
+    return Py_BuildValue("n", static_cast<Py_ssize_t>(
+          self->genome->intersect_snp_count(other, threads)));
+  });
+}
+
+PyObject* Genome_intersect_internal(PyGenome* self, PyObject* other)
 {
   if ( !PyObject_TypeCheck(other, &GenomeType) ) {
     PyErr_SetString(PyExc_TypeError,
@@ -250,32 +660,48 @@ PyObject* Genome_intersect_snp(PyGenome* self, PyObject* other)
   }
 
   const auto right = reinterpret_cast<PyGenome*>(other);
-  const auto rsids = self->genome->intersect_snp(*right->genome);
+  const auto ids = self->genome->intersect_internal(*right->genome);
 
-  auto list = PyList_New(rsids.size());
+  auto list = PyList_New(ids.size());
   size_t n=0;
-  for ( const auto& rsid : rsids )
-    PyList_SetItem(list, n++, Py_BuildValue("I", rsid));
+  for ( const auto& id : ids )
+    PyList_SetItem(list, n++, Py_BuildValue("I", id));
+
+  return list;
+}
+
+PyObject* Genome_internal_ids(PyGenome* self)
+{
+  const auto ids = self->genome->internal_ids();
+  auto list = PyTuple_New(ids.size());
+
+  size_t n=0;
+  for ( const auto& id : ids )
+    PyTuple_SetItem(list, n++, Py_BuildValue("I", id));
 
   return list;
 }
 
 PyObject* Genome_rsids(PyGenome* self)
 {
-  // TODO: Should use an iterator instead (preferrably that doesn't copy)
+  // For bulk access without an object per SNP, see Genome_columns
   const auto rsids = self->genome->rsids();
   auto list = PyTuple_New(rsids.size());
 
   size_t n=0;
   for ( const auto& rsid : rsids )
-    PyTuple_SetItem(list, n++, Py_BuildValue("I", rsid));
+    PyTuple_SetItem(list, n++, PyInt_FromLong(rsid));
 
   return list;
 }
 
+PyObject* Genome_columns(PyGenome* self)
+{
+  return new_columns(*self->genome);
+}
+
 PyObject* Genome_snps(PyGenome* self)
 {
-  // TODO: Should use an iterator instead (preferrably that doesn't copy)
   const auto snps = self->genome->snps();
   auto list = PyTuple_New(snps.size());
 
@@ -285,3 +711,95 @@ PyObject* Genome_snps(PyGenome* self)
 
   return list;
 }
+
+PyObject* Genome_find(PyGenome* self, PyObject* args)
+{
+  PyObject* chromosome = NULL;
+  unsigned start = 0;
+  unsigned end = 0xffffffff;
+  Chromosome chr;
+
+  if ( !PyArg_ParseTuple(args, "O|II", &chromosome, &start, &end) ||
+       !pyobj_to_chromosome(chromosome, chr) )
+    return NULL;
+
+  const SNPSpan span = self->genome->find(chr, start, end);
+  auto list = PyList_New(span.size);
+
+  for ( size_t n = 0; n < span.size; ++n ) {
+    auto item = PyTuple_New(2);
+    PyTuple_SetItem(item, 0, Py_BuildValue("I", span.rsids[n]));
+    PyTuple_SetItem(item, 1, snp_to_pyobj(span.snps[n]));
+    PyList_SetItem(list, n, item);
+  }
+
+  return list;
+}
+
+PyObject* Genome_save(PyGenome* self, PyObject* args)
+{
+  try {
+    char *file = NULL;
+    if ( !PyArg_ParseTuple(args, "s", &file) )
+      return NULL;
+
+    self->genome->save(file);
+    Py_RETURN_NONE;
+  }
+  catch ( const std::exception& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
+
+PyObject* Genome_publish(PyGenome* self, PyObject* args)
+{
+  try {
+    char *name = NULL;
+    if ( !PyArg_ParseTuple(args, "s", &name) )
+      return NULL;
+
+    self->genome->publish(name);
+    Py_RETURN_NONE;
+  }
+  catch ( const std::exception& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
+
+PyObject* Genome_attach(PyGenome* self, PyObject* args)
+{
+  try {
+    char *name = NULL;
+    PyObject* verify = Py_False;
+    if ( !PyArg_ParseTuple(args, "s|O", &name, &verify) )
+      return NULL;
+
+    self->genome->attach(name, PyObject_IsTrue(verify));
+    self->version++;
+    Py_RETURN_NONE;
+  }
+  catch ( const std::exception& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
+
+PyObject* Genome_load(PyGenome* self, PyObject* args)
+{
+  try {
+    char *file = NULL;
+    PyObject* verify = Py_False;
+    if ( !PyArg_ParseTuple(args, "s|O", &file, &verify) )
+      return NULL;
+
+    self->genome->load(file, PyObject_IsTrue(verify));
+    self->version++;
+    Py_RETURN_NONE;
+  }
+  catch ( const std::exception& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
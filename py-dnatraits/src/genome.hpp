@@ -8,22 +8,58 @@
 
 #include <Python.h>
 #include <structmember.h>
+#include <vector>
 #include "dnatraits.hpp"
 
 struct PyGenome {
   PyObject_HEAD
   Genome *genome;
+  unsigned long version; // bumped when the contents are replaced
 };
 
+/*
+ * Iterates over a genome's SNPs as (rsid, genotype, chromosome, position)
+ * tuples, either in the order they're stored or sorted by RSID.
+ */
+struct PyGenomeIter {
+  PyObject_HEAD
+  PyGenome *genome;
+  unsigned long version;
+  GenomeIterator *current;
+  GenomeIterator *end;
+  std::vector<RSID> *order; // RSIDs to visit, when sorted
+  size_t index;
+  PyObject *item; // handed out again if nobody kept it
+};
+
+/*
+ * Shared genotype strings and chromosome objects, as returned for SNPs.
+ */
+PyObject* chromosome_to_pyobj(const Chromosome);
+PyObject* genotype_to_pyobj(const Genotype&);
+
+PyObject* Genome_columns(PyGenome*);
 PyObject* Genome_eq(PyGenome*, PyObject*);
+PyObject* Genome_find(PyGenome*, PyObject*);
+PyObject* Genome_attach(PyGenome*, PyObject*);
 PyObject* Genome_first(PyGenome*);
+PyObject* Genome_get_many(PyGenome*, PyObject*);
 PyObject* Genome_getitem(PyObject*, PyObject*);
+PyObject* Genome_internal(PyGenome*, PyObject*);
+PyObject* Genome_items(PyGenome*);
+PyObject* Genome_iter(PyObject*);
+PyObject* Genome_internal_ids(PyGenome*);
+PyObject* Genome_internal_size(PyGenome*);
+PyObject* Genome_intersect_internal(PyGenome*, PyObject*);
 PyObject* Genome_intersect_rsid(PyGenome*, PyObject*);
 PyObject* Genome_intersect_snp(PyGenome*, PyObject*);
+PyObject* Genome_intersect_rsid_count(PyGenome*, PyObject*);
+PyObject* Genome_intersect_snp_count(PyGenome*, PyObject*);
 PyObject* Genome_last(PyGenome*);
 PyObject* Genome_load(PyGenome*, PyObject*);
 PyObject* Genome_load_factor(PyGenome*);
 PyObject* Genome_new(PyTypeObject*, PyObject*, PyObject*);
+PyObject* Genome_publish(PyGenome*, PyObject*);
 PyObject* Genome_rsids(PyGenome*);
 PyObject* Genome_save(PyGenome*, PyObject*);
 PyObject* Genome_snps(PyGenome*);
@@ -36,4 +72,8 @@ extern PyTypeObject GenomeType;
 int Genome_init(PyGenome*, PyObject*, PyObject*);
 void Genome_dealloc(PyGenome* self);
 
+PyObject* GenomeIter_next(PyGenomeIter*);
+extern PyTypeObject GenomeIterType;
+void GenomeIter_dealloc(PyGenomeIter*);
+
 #endif
@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <stdexcept>
+#include <vector>
+#include "genome.hpp"
+#include "rules.hpp"
+
+/*
+ * Sets a Python exception, with syntax errors as ValueError.
+ */
+static PyObject* set_error(const std::exception& e)
+{
+  if ( dynamic_cast<const std::invalid_argument*>(&e) != NULL )
+    PyErr_SetString(PyExc_ValueError, e.what());
+  else
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+  return NULL;
+}
+
+/*
+ * Returns a tuple of booleans, one per rule.
+ */
+static PyObject* results_to_pyobj(const std::uint8_t* results,
+    const size_t count)
+{
+  auto tuple = PyTuple_New(count);
+
+  for ( size_t n = 0; n < count; ++n )
+    PyTuple_SetItem(tuple, n, PyBool_FromLong(results[n]));
+
+  return tuple;
+}
+
+PySequenceMethods RuleSet_seq = {
+  RuleSet_length,
+  0, // concat
+  0, // repeat
+  0, // item
+  0, // slice
+  0, // ass item
+  0, // ass slice
+  0, // contains
+  0, // inplace concat
+  0, // inplace repeat
+};
+
+PyMethodDef RuleSet_methods[] = {
+  {"add", (PyCFunction)RuleSet_add, METH_VARARGS,
+    "Compiles and adds the rules in the given string."},
+  {"load", (PyCFunction)RuleSet_load, METH_VARARGS,
+    "Compiles and adds the rules in the given file."},
+  {"names", (PyCFunction)RuleSet_names, METH_NOARGS,
+    "Returns a tuple of the rule names, in order."},
+  {"rsids", (PyCFunction)RuleSet_rsids, METH_NOARGS,
+    "Returns a list of the RSIDs used by the rules."},
+  {"evaluate", (PyCFunction)RuleSet_evaluate, METH_VARARGS,
+    "Evaluates the rules against a Genome, and returns a tuple with a bool\n"
+    "per rule. Given a list of genomes instead, returns a list of tuples.\n"
+    "An optional second argument gives the number of threads to use for\n"
+    "lists, zero meaning one per CPU."},
+  {NULL, NULL, 0, NULL}
+};
+
+PyTypeObject RuleSetType = {
+  PyObject_HEAD_INIT(NULL)
+  0, // obsize
+  "dna_traits.RuleSet", // tpname
+  sizeof(PyRuleSet), // basicsize
+  0, // itemsize
+  (destructor)RuleSet_dealloc, // dealloc
+  0, // print
+  0, // getattr
+  0, // setattr
+  0, // tpcompare
+  0, // tprepr
+  0, // tp as number
+  &RuleSet_seq, // tp as seq
+  0, // tp as map
+  0, // tp hash
+  0, // tp call
+  0, // tp str
+  0, // tp getattro
+  0, // tp setattro
+  0, // tp as buff
+  Py_TPFLAGS_DEFAULT, // tpflags
+  "Compiled genotype rules, evaluated against genomes in one pass.", // docs
+  0, // traverse
+  0, // clear
+  0, // rich compare
+  0, // weaklistoffset
+  0, // iter
+  0, // iternext
+  RuleSet_methods, // methods
+  0, // members
+  0, // getset
+  0, // base
+  0, // dict
+  0, // descr get
+  0, // descr set
+  0, // dictoffset
+  0, // init
+  0, // alloc
+  RuleSet_new, // tp new
+  NULL, // tp free
+  NULL, // tp_is_gc
+  NULL, // tp_bases
+  NULL, // tp_mro
+  NULL, // tp_cache
+  NULL, // tp_subclasses
+  NULL, // tp_weaklist
+  NULL, // tp_del
+  0, // tp_version_tag
+};
+
+void RuleSet_dealloc(PyRuleSet* self)
+{
+  delete(self->rules);
+  self->ob_type->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+PyObject* RuleSet_new(PyTypeObject* type,
+                      PyObject* /*args*/,
+                      PyObject* /*kw*/)
+{
+  auto p = reinterpret_cast<PyRuleSet*>(type->tp_alloc(type, 0));
+
+  if ( p != NULL )
+    p->rules = new RuleSet();
+
+  return reinterpret_cast<PyObject*>(p);
+}
+
+Py_ssize_t RuleSet_length(PyObject* self)
+{
+  auto rules = reinterpret_cast<PyRuleSet*>(self);
+  return static_cast<Py_ssize_t>(rules->rules->size());
+}
+
+PyObject* RuleSet_add(PyRuleSet* self, PyObject* args)
+{
+  try {
+    char *text = NULL;
+    if ( !PyArg_ParseTuple(args, "s", &text) )
+      return NULL;
+
+    self->rules->add(text);
+    Py_RETURN_NONE;
+  }
+  catch ( const std::exception& e ) {
+    return set_error(e);
+  }
+}
+
+PyObject* RuleSet_load(PyRuleSet* self, PyObject* args)
+{
+  try {
+    char *file = NULL;
+    if ( !PyArg_ParseTuple(args, "s", &file) )
+      return NULL;
+
+    self->rules->load(file);
+    Py_RETURN_NONE;
+  }
+  catch ( const std::exception& e ) {
+    return set_error(e);
+  }
+}
+
+PyObject* RuleSet_names(PyRuleSet* self)
+{
+  const size_t count = self->rules->size();
+  auto tuple = PyTuple_New(count);
+
+  for ( size_t n = 0; n < count; ++n )
+    PyTuple_SetItem(tuple, n,
+        Py_BuildValue("s", self->rules->name(n).c_str()));
+
+  return tuple;
+}
+
+PyObject* RuleSet_rsids(PyRuleSet* self)
+{
+  const auto rsids = self->rules->rsids();
+  auto list = PyList_New(rsids.size());
+
+  size_t n=0;
+  for ( const auto& rsid : rsids )
+    PyList_SetItem(list, n++, Py_BuildValue("I", rsid));
+
+  return list;
+}
+
+PyObject* RuleSet_evaluate(PyRuleSet* self, PyObject* args)
+{
+  PyObject* genomes_ = NULL;
+  unsigned threads = 1;
+  if ( !PyArg_ParseTuple(args, "O|I", &genomes_, &threads) )
+    return NULL;
+
+  const size_t count = self->rules->size();
+
+  if ( PyObject_TypeCheck(genomes_, &GenomeType) ) {
+    const auto results = self->rules->evaluate(
+        *reinterpret_cast<PyGenome*>(genomes_)->genome);
+    return results_to_pyobj(results.data(), count);
+  }
+
+  auto seq = PySequence_Fast(genomes_, "Expected a Genome or a sequence.");
+  if ( seq == NULL )
+    return NULL;
+
+  const Py_ssize_t size = PySequence_Fast_GET_SIZE(seq);
+  std::vector<const Genome*> genomes(size);
+
+  for ( Py_ssize_t n = 0; n < size; ++n ) {
+    auto item = PySequence_Fast_GET_ITEM(seq, n);
+
+    if ( !PyObject_TypeCheck(item, &GenomeType) ) {
+      Py_DECREF(seq);
+      PyErr_SetString(PyExc_TypeError, "Expected a sequence of Genomes.");
+      return NULL;
+    }
+
+    genomes[n] = reinterpret_cast<PyGenome*>(item)->genome;
+  }
+
+  const auto results = self->rules->evaluate(genomes, threads);
+  Py_DECREF(seq);
+
+  auto list = PyList_New(size);
+  for ( Py_ssize_t n = 0; n < size; ++n )
+    PyList_SetItem(list, n,
+        results_to_pyobj(results.data() + n*count, count));
+
+  return list;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef INC_DNATRAITS_RULES_HPP_20160903
+#define INC_DNATRAITS_RULES_HPP_20160903
+
+#include <Python.h>
+#include <structmember.h>
+#include "dnatraits.hpp"
+
+struct PyRuleSet {
+  PyObject_HEAD
+  RuleSet *rules;
+};
+
+PyObject* RuleSet_add(PyRuleSet*, PyObject*);
+PyObject* RuleSet_evaluate(PyRuleSet*, PyObject*);
+PyObject* RuleSet_load(PyRuleSet*, PyObject*);
+PyObject* RuleSet_names(PyRuleSet*);
+PyObject* RuleSet_new(PyTypeObject*, PyObject*, PyObject*);
+PyObject* RuleSet_rsids(PyRuleSet*);
+Py_ssize_t RuleSet_length(PyObject*);
+extern PyMethodDef RuleSet_methods[];
+extern PySequenceMethods RuleSet_seq;
+extern PyTypeObject RuleSetType;
+void RuleSet_dealloc(PyRuleSet* self);
+
+#endif
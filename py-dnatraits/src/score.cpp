@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#include <stdexcept>
+#include <vector>
+#include "genome.hpp"
+#include "score.hpp"
+
+static bool to_nucleotide(const char* s, Nucleotide& n)
+{
+  if ( s == NULL ) {
+    n = NONE;
+    return true;
+  }
+
+  switch ( s[0] != '\0' && s[1] == '\0'? s[0] : '?' ) {
+    case 'A': n = A; return true;
+    case 'C': n = C; return true;
+    case 'G': n = G; return true;
+    case 'T': n = T; return true;
+    case 'D': n = D; return true;
+    case 'I': n = I; return true;
+    default:
+      PyErr_SetString(PyExc_ValueError, "Alleles must be one of ACGTDI.");
+      return false;
+  }
+}
+
+static PyObject* sum_to_pyobj(const ScoreSum& s)
+{
+  return Py_BuildValue("(dI)", s.sum, s.variants);
+}
+
+PySequenceMethods PolygenicScore_seq = {
+  PolygenicScore_length,
+  0, // concat
+  0, // repeat
+  0, // item
+  0, // slice
+  0, // ass item
+  0, // ass slice
+  0, // contains
+  0, // inplace concat
+  0, // inplace repeat
+};
+
+PyMethodDef PolygenicScore_methods[] = {
+  {"add", (PyCFunction)PolygenicScore_add, METH_VARARGS,
+    "Adds a variant, given an integer RSID, the effect allele, its weight\n"
+    "and optionally the other allele."},
+  {"load", (PyCFunction)PolygenicScore_load, METH_VARARGS,
+    "Adds the variants in a weights file, and returns the number skipped\n"
+    "because their alleles weren't single nucleotides."},
+  {"rsids", (PyCFunction)PolygenicScore_rsids, METH_NOARGS,
+    "Returns a list of the RSIDs of the variants."},
+  {"score", (PyCFunction)PolygenicScore_score, METH_VARARGS,
+    "Scores a Genome, and returns (sum, variants), where variants is the\n"
+    "number that had a usable call. Given a list of genomes instead,\n"
+    "returns a list of those. An optional second argument gives the number\n"
+    "of threads to use for lists, zero meaning one per CPU."},
+  {NULL, NULL, 0, NULL}
+};
+
+PyTypeObject PolygenicScoreType = {
+  PyObject_HEAD_INIT(NULL)
+  0, // obsize
+  "dna_traits.PolygenicScore", // tpname
+  sizeof(PyPolygenicScore), // basicsize
+  0, // itemsize
+  (destructor)PolygenicScore_dealloc, // dealloc
+  0, // print
+  0, // getattr
+  0, // setattr
+  0, // tpcompare
+  0, // tprepr
+  0, // tp as number
+  &PolygenicScore_seq, // tp as seq
+  0, // tp as map
+  0, // tp hash
+  0, // tp call
+  0, // tp str
+  0, // tp getattro
+  0, // tp setattro
+  0, // tp as buff
+  Py_TPFLAGS_DEFAULT, // tpflags
+  "A polygenic score model, with a weight per effect allele.", // docs
+  0, // traverse
+  0, // clear
+  0, // rich compare
+  0, // weaklistoffset
+  0, // iter
+  0, // iternext
+  PolygenicScore_methods, // methods
+  0, // members
+  0, // getset
+  0, // base
+  0, // dict
+  0, // descr get
+  0, // descr set
+  0, // dictoffset
+  0, // init
+  0, // alloc
+  PolygenicScore_new, // tp new
+  NULL, // tp free
+  NULL, // tp_is_gc
+  NULL, // tp_bases
+  NULL, // tp_mro
+  NULL, // tp_cache
+  NULL, // tp_subclasses
+  NULL, // tp_weaklist
+  NULL, // tp_del
+  0, // tp_version_tag
+};
+
+void PolygenicScore_dealloc(PyPolygenicScore* self)
+{
+  delete(self->model);
+  self->ob_type->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+PyObject* PolygenicScore_new(PyTypeObject* type,
+                             PyObject* /*args*/,
+                             PyObject* /*kw*/)
+{
+  auto p = reinterpret_cast<PyPolygenicScore*>(type->tp_alloc(type, 0));
+
+  if ( p != NULL )
+    p->model = new PolygenicScore();
+
+  return reinterpret_cast<PyObject*>(p);
+}
+
+Py_ssize_t PolygenicScore_length(PyObject* self)
+{
+  auto model = reinterpret_cast<PyPolygenicScore*>(self);
+  return static_cast<Py_ssize_t>(model->model->size());
+}
+
+PyObject* PolygenicScore_add(PyPolygenicScore* self, PyObject* args)
+{
+  unsigned rsid = 0;
+  char* effect = NULL;
+  double weight = 0;
+  char* other = NULL;
+  if ( !PyArg_ParseTuple(args, "Isd|z", &rsid, &effect, &weight, &other) )
+    return NULL;
+
+  Nucleotide e, o;
+  if ( !to_nucleotide(effect, e) || !to_nucleotide(other, o) )
+    return NULL;
+
+  self->model->add(rsid, e, weight, o);
+  Py_RETURN_NONE;
+}
+
+PyObject* PolygenicScore_load(PyPolygenicScore* self, PyObject* args)
+{
+  try {
+    char *file = NULL;
+    if ( !PyArg_ParseTuple(args, "s", &file) )
+      return NULL;
+
+    return Py_BuildValue("n",
+        static_cast<Py_ssize_t>(self->model->load(file)));
+  }
+  catch ( const std::invalid_argument& e ) {
+    PyErr_SetString(PyExc_ValueError, e.what());
+    return NULL;
+  }
+  catch ( const std::exception& e ) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return NULL;
+  }
+}
+
+PyObject* PolygenicScore_rsids(PyPolygenicScore* self)
+{
+  const auto rsids = self->model->rsids();
+  auto list = PyList_New(rsids.size());
+
+  size_t n=0;
+  for ( const auto& rsid : rsids )
+    PyList_SetItem(list, n++, Py_BuildValue("I", rsid));
+
+  return list;
+}
+
+PyObject* PolygenicScore_score(PyPolygenicScore* self, PyObject* args)
+{
+  PyObject* genomes_ = NULL;
+  unsigned threads = 1;
+  if ( !PyArg_ParseTuple(args, "O|I", &genomes_, &threads) )
+    return NULL;
+
+  if ( PyObject_TypeCheck(genomes_, &GenomeType) )
+    return sum_to_pyobj(self->model->score(
+          *reinterpret_cast<PyGenome*>(genomes_)->genome));
+
+  auto seq = PySequence_Fast(genomes_, "Expected a Genome or a sequence.");
+  if ( seq == NULL )
+    return NULL;
+
+  const Py_ssize_t size = PySequence_Fast_GET_SIZE(seq);
+  std::vector<const Genome*> genomes(size);
+
+  for ( Py_ssize_t n = 0; n < size; ++n ) {
+    auto item = PySequence_Fast_GET_ITEM(seq, n);
+
+    if ( !PyObject_TypeCheck(item, &GenomeType) ) {
+      Py_DECREF(seq);
+      PyErr_SetString(PyExc_TypeError, "Expected a sequence of Genomes.");
+      return NULL;
+    }
+
+    genomes[n] = reinterpret_cast<PyGenome*>(item)->genome;
+  }
+
+  const auto sums = self->model->score(genomes, threads);
+  Py_DECREF(seq);
+
+  auto list = PyList_New(size);
+  for ( Py_ssize_t n = 0; n < size; ++n )
+    PyList_SetItem(list, n, sum_to_pyobj(sums[n]));
+
+  return list;
+}
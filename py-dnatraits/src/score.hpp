@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2014, 2016 Christian Stigen Larsen
+ * Distributed under the GPL v3 or later. See COPYING.
+ */
+
+#ifndef INC_DNATRAITS_SCORE_HPP_20160903
+#define INC_DNATRAITS_SCORE_HPP_20160903
+
+#include <Python.h>
+#include <structmember.h>
+#include "dnatraits.hpp"
+
+struct PyPolygenicScore {
+  PyObject_HEAD
+  PolygenicScore *model;
+};
+
+PyObject* PolygenicScore_add(PyPolygenicScore*, PyObject*);
+PyObject* PolygenicScore_load(PyPolygenicScore*, PyObject*);
+PyObject* PolygenicScore_new(PyTypeObject*, PyObject*, PyObject*);
+PyObject* PolygenicScore_rsids(PyPolygenicScore*);
+PyObject* PolygenicScore_score(PyPolygenicScore*, PyObject*);
+Py_ssize_t PolygenicScore_length(PyObject*);
+extern PyMethodDef PolygenicScore_methods[];
+extern PySequenceMethods PolygenicScore_seq;
+extern PyTypeObject PolygenicScoreType;
+void PolygenicScore_dealloc(PyPolygenicScore* self);
+
+#endif
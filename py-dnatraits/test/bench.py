@@ -21,11 +21,24 @@ for n in xrange(5000):
 
     "iterate items in genome":
 r"""
-assert(False) # this is too slow at the moment
 num = 0
 for snp in genome:
     num += 1
 assert(num == len(genome))
+""",
+
+    "iterate raw items in genome":
+r"""
+num = 0
+for item in genome.iteritems():
+    num += 1
+assert(num == len(genome))
+""",
+
+    "columns":
+r"""
+columns = genome.columns()
+assert(len(columns["rsid"]) == len(genome))
 """,
 
     "iterate rsids":
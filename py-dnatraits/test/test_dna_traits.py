@@ -1,7 +1,12 @@
 # Copyright (C) 2014, 2016 Christian Stigen Larsen
 # Distributed under the GPL v3 or later. See COPYING.
 
+import gzip
+import os
+import subprocess
+import tempfile
 import unittest
+import zipfile
 import dna_traits as dt
 
 class TestGenome(unittest.TestCase):
@@ -21,6 +26,22 @@ class TestGenome(unittest.TestCase):
                 break
         self.assertEqual(sorted(rsids), rsids)
 
+    def test_iteritems(self):
+        items = list(self.genome.iteritems())
+        self.assertEqual(len(items), len(self.genome))
+        self.assertEqual(sorted(items), items)
+
+        # Storage order, but the same SNPs
+        self.assertEqual(sorted(self.genome._genome), items)
+
+        for rsid, genotype, chromo, position in items[:100]:
+            self.assertEqual((genotype, chromo, position),
+                    self.genome._genome[rsid])
+
+        for snp in self.genome:
+            self.assertEqual(repr(snp), repr(self.genome[snp.rsid]))
+            break
+
     def test_slice(self):
         self.assertEqual(len(self.genome[0:10]), 10)
 
@@ -37,6 +58,326 @@ class TestGenome(unittest.TestCase):
         self.assertNotEqual(self.genome.male, self.genome.female)
         self.assertEqual(self.genome.male, self.genome.y_chromosome)
 
+    def test_parse_threads(self):
+        genome = dt.parse("../genomes/genome.txt", threads=4)
+        self.assertEqual(genome.first, self.genome.first)
+        self.assertEqual(genome.last, self.genome.last)
+        self.assertEqual(genome.y_chromosome, self.genome.y_chromosome)
+        self.assertEqual(genome, self.genome)
+
+    def test_parse_advice(self):
+        advice = (dt.ADVISE_SEQUENTIAL | dt.ADVISE_WILLNEED |
+                dt.ADVISE_POPULATE | dt.ADVISE_HUGEPAGES)
+        genome = dt.parse("../genomes/genome.txt", advice=advice)
+        self.assertEqual(genome, self.genome)
+
+        self.assertTrue(dt._dna_traits.prefetch("../genomes/genome.txt"))
+        self.assertFalse(dt._dna_traits.prefetch("../genomes/missing.txt"))
+
+        genomes = list(dt.parse_files(["../genomes/genome.txt"]*3,
+            lookahead=1, threads=2))
+        self.assertEqual(len(genomes), 3)
+        for genome in genomes:
+            self.assertEqual(genome, self.genome)
+
+    def test_parse_sorted(self):
+        for threads in [1, 4]:
+            genome = dt.parse("../genomes/genome.txt", threads=threads,
+                    storage=dt.STORAGE_SORTED)
+            self.assertEqual(genome, self.genome)
+            self.assertEqual(genome.first, self.genome.first)
+            self.assertEqual(genome.internal_ids, self.genome.internal_ids)
+            self.assertEqual(genome.rsids, sorted(self.genome.rsids))
+            self.assertNotIn("rs1", genome)
+
+        filename = tempfile.mktemp(suffix=".genome")
+        try:
+            genome.save(filename)
+            self.assertEqual(dt.load(filename), self.genome)
+        finally:
+            os.remove(filename)
+
+    def test_parse_buffer(self):
+        with open("../genomes/genome.txt", "rb") as f:
+            data = f.read()
+        self.assertEqual(dt.parse_buffer(data), self.genome)
+        self.assertEqual(dt.parse_buffer(bytearray(data)), self.genome)
+        self.assertEqual(dt.parse_buffer(memoryview(data)), self.genome)
+
+        # No trailing newline, and a last line cut short
+        genome = dt.parse_buffer("rs3\t1\t1234\tAG\nrs4\t2\t42\tT")
+        self.assertEqual(len(genome), 2)
+        self.assertEqual(str(genome["rs4"]), "T-")
+        self.assertEqual(len(dt.parse_buffer("rs3\t1\t12")), 1)
+
+    def test_parse_formats(self):
+        with open("../genomes/genome.txt", "rb") as f:
+            lines = [l.rstrip("\r\n").split("\t") for l in f
+                     if l.startswith("rs")][:20000]
+
+        expected = dt.parse_buffer(
+            "".join("\t".join(l) + "\n" for l in lines))
+
+        ancestry_chr = {"X": "23", "Y": "24", "MT": "26"}
+        ancestry = ["#AncestryDNA raw data download\n",
+                    "rsid\tchromosome\tposition\tallele1\tallele2\n"]
+        for rsid, chromo, pos, gt in lines:
+            gt = gt.replace("-", "0").ljust(2, "0")
+            ancestry.append("\t".join([rsid, ancestry_chr.get(chromo, chromo),
+                                       pos, gt[0], gt[1]]) + "\n")
+
+        csv = ["RSID,CHROMOSOME,POSITION,RESULT\n"]
+        for l in lines:
+            csv.append(",".join('"%s"' % f for f in l) + "\n")
+
+        # Long enough to be stepped over by the vector kernels
+        info = ";".join(["DP=10"] + ["AF=0.5"] * 12)
+        vcf = ["##fileformat=VCFv4.2\n",
+               "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\n"]
+        for rsid, chromo, pos, gt in lines:
+            if gt == "--":
+                ref, alt, call = "N", ".", "./."
+            elif len(gt) == 1:
+                ref, alt, call = gt, ".", "0"
+            elif gt[0] == gt[1]:
+                ref, alt, call = gt[0], ".", "0/0"
+            else:
+                ref, alt, call = gt[0], "%s,<NON_REF>" % gt[1], "0|1"
+            vcf.append("\t".join(["chr" + chromo, pos, rsid, ref, alt, ".",
+                                  "PASS", info, "GT:DP", call + ":10"]) +
+                       "\n")
+
+        for data in (ancestry, csv, vcf):
+            errors = []
+            genome = dt.parse_buffer("".join(data), errors=errors)
+            self.assertEqual(errors, [])
+            self.assertEqual(len(genome), len(expected))
+            self.assertEqual(genome, expected)
+
+    def test_parse_validate(self):
+        data = ("# comment\n"
+                "rs1\t1\t100\tAG\n"
+                "rs2\t0\t100\tAG\n"
+                "rs3\t1\t\tAG\n"
+                "rs4\t1\t100\tAQ\n"
+                "rs5x\t1\t100\tAA\n"
+                "rs6\tX\t100\tA\r\n"
+                "rs\t1\t100\tAG\n"
+                "rs0\t1\t100\tAG\n"
+                "rs99999999999\t1\t100\tAG\n"
+                "rs4294967296\t1\t100\tAG\n"
+                "rs8\t26\t100\tAG\n"
+                "rs9\t1\t99999999999\tAG\n"
+                "i0\t1\t100\tAG\n"
+                "rs4294967295\t1\t100\tAG\n"
+                "rs7\t1\t100\tAG")
+        errors = []
+        genome = dt.parse_buffer(data, errors=errors)
+        self.assertEqual(errors, [(3, "Invalid chromosome"),
+                                  (4, "Invalid position"),
+                                  (5, "Invalid genotype"),
+                                  (6, "Invalid ID"),
+                                  (8, "Invalid ID"),
+                                  (9, "Invalid ID"),
+                                  (10, "Invalid ID"),
+                                  (11, "Invalid ID"),
+                                  (12, "Invalid chromosome"),
+                                  (13, "Invalid position"),
+                                  (14, "Invalid ID")])
+        self.assertEqual(len(genome), 4)
+        self.assertIn("rs4294967295", genome)
+
+        # Line numbers don't depend on how the input is split up
+        with open("../genomes/genome.txt", "rb") as f:
+            lines = f.readlines()
+        lines[len(lines)*3/4] = "rs1\t1\t100\tAG\tX\n"
+        expected = [(len(lines)*3/4 + 1, "Invalid genotype")]
+
+        for threads in (1, 4):
+            errors = []
+            dt.parse_buffer("".join(lines), threads=threads, errors=errors)
+            self.assertEqual(errors, expected)
+
+    def test_parse_compressed(self):
+        with open("../genomes/genome.txt", "rb") as f:
+            data = f.read()
+
+        filename = tempfile.mktemp(suffix=".txt.gz")
+        try:
+            with gzip.open(filename, "wb") as f:
+                f.write(data)
+            self.assertEqual(dt.parse(filename), self.genome)
+        finally:
+            os.remove(filename)
+
+        filename = tempfile.mktemp(suffix=".zip")
+        try:
+            with zipfile.ZipFile(filename, "w", zipfile.ZIP_DEFLATED) as f:
+                f.writestr("genome.txt", data)
+            self.assertEqual(dt.parse(filename), self.genome)
+        finally:
+            os.remove(filename)
+
+    def test_parse_stream(self):
+        for threads in (1, 4):
+            with open("../genomes/genome.txt", "rb") as f:
+                cat = subprocess.Popen(["cat"], stdin=f,
+                        stdout=subprocess.PIPE)
+                errors = []
+                genome = dt.parse_stream(cat.stdout, threads=threads,
+                        errors=errors)
+                cat.wait()
+            self.assertEqual(errors, [])
+            self.assertEqual(genome, self.genome)
+            self.assertEqual(genome.first, self.genome.first)
+            self.assertEqual(genome.y_chromosome, self.genome.y_chromosome)
+
+    def test_get_many(self):
+        rsids = ["rs7495174", 4778241, "rs1", "rs12913832"]
+        snps = self.genome.get_many(rsids)
+        self.assertEqual([repr(s) for s in snps],
+                         [repr(self.genome[r]) for r in rsids])
+        self.assertEqual(self.genome._genome.get_many([1])[0], None)
+        self.assertRaises(ValueError, self.genome._genome.get_many, [-1])
+        self.assertEqual(repr(self.genome._genome.get_many([4778241L])[0]),
+                         repr(self.genome._genome.get_many([4778241])[0]))
+        for bad in (1 << 32, 1 << 64, "rs1"):
+            self.assertRaises(ValueError, self.genome._genome.get_many, [bad])
+
+    def test_columns(self):
+        columns = self.genome.columns()
+        items = list(self.genome.iteritems())
+        for name in ["rsid", "chromosome", "position", "genotype"]:
+            self.assertEqual(len(columns[name]), len(items))
+
+        rsids = memoryview(columns["rsid"])
+        self.assertEqual(rsids.format, "I")
+        self.assertEqual(rsids.itemsize, 4)
+        self.assertTrue(rsids.readonly)
+        self.assertEqual(list(columns["rsid"]), [item[0] for item in items])
+        self.assertEqual(len(buffer(columns["position"])), 4*len(items))
+
+        for n in range(0, len(items), 997):
+            rsid, genotype, chromo, position = items[n]
+            self.assertEqual(columns["rsid"][n], rsid)
+            self.assertEqual(columns["position"][n], position)
+            self.assertEqual(
+                dt.CHROMOSOME_CODES[columns["chromosome"][n]], chromo)
+            # Codes don't keep the order of the alleles
+            self.assertEqual(
+                sorted(dt.GENOTYPE_CODES[columns["genotype"][n]]),
+                sorted(genotype))
+
+        self.assertRaises(IndexError, lambda: columns["rsid"][len(items)])
+
+    def test_rules(self):
+        rules = dt.RuleSet("""
+            # Blue eyes
+            gs237: rs4778241 CC & rs12913832 GG & rs7495174 AA
+                   & rs8028689 TT & rs7183877 CC & rs1800401 ~CC
+            earwax: rs17822931 CC/CT | rs17822931 --
+            """)
+        self.assertEqual(rules.names, ("gs237", "earwax"))
+        self.assertEqual(len(rules.rsids), 7)
+
+        result = rules.evaluate(self.genome)
+        self.assertEqual(result["gs237"], self.genome.rs4778241 == "CC" and
+            self.genome.rs12913832 == "GG" and
+            self.genome.rs7495174 == "AA" and
+            self.genome.rs8028689 == "TT" and
+            self.genome.rs7183877 == "CC" and
+            self.genome.rs1800401 == "~CC")
+        self.assertEqual(result["earwax"],
+            str(self.genome.rs17822931) in ["CC", "CT", "TC", "--", ""])
+        self.assertEqual(rules.evaluate_many([self.genome]*3, 2), [result]*3)
+        self.assertRaises(ValueError, rules.add, "bad: rs1 XY")
+
+    def test_polygenic_score(self):
+        model = dt.PolygenicScore()
+        model.add("rs7495174", "C", 0.5, "T")
+        model.add(4778241, "G", 2.0, "A") # two C on the other strand
+        model.add("rs12913832", "A", -1.0, "G") # no T on the other strand
+        model.add(1, "A", 1.0)
+        self.assertEqual(len(model), 4)
+
+        for rsid in ["rs7495174", "rs4778241", "rs12913832"]:
+            self.assertEqual(str(self.genome[rsid]), "CC")
+        self.assertEqual(model.score(self.genome), (5.0, 3))
+        self.assertEqual(model.score_many([self.genome]*3, 2),
+                [(5.0, 3)]*3)
+        self.assertRaises(ValueError, model.add, 2, "AT", 1.0)
+
+    def test_publish_attach(self):
+        name = "/dna-traits-test-%d" % os.getpid()
+        try:
+            self.genome.publish(name)
+            genome = dt.attach(name, verify=True)
+            self.assertEqual(genome, self.genome)
+            self.assertEqual(genome.first, self.genome.first)
+            self.assertEqual(genome["rs7495174"], self.genome["rs7495174"])
+        finally:
+            self.assertTrue(dt.unpublish(name))
+        self.assertFalse(dt.unpublish(name))
+        self.assertEqual(len(genome), len(self.genome))
+
+    def test_save_load(self):
+        filename = tempfile.mktemp(suffix=".genome")
+        try:
+            self.genome.save(filename)
+            genome = dt.load(filename, verify=True)
+            self.assertEqual(len(genome), len(self.genome))
+            self.assertEqual(genome.first, self.genome.first)
+            self.assertEqual(genome.last, self.genome.last)
+            self.assertEqual(genome.y_chromosome, self.genome.y_chromosome)
+            self.assertEqual(genome, self.genome)
+            self.assertEqual(genome["rs7495174"], self.genome["rs7495174"])
+            self.assertEqual(genome.internal_ids, self.genome.internal_ids)
+        finally:
+            os.remove(filename)
+
+    def test_intersect(self):
+        genome = dt.parse("../genomes/genome.txt", storage=dt.STORAGE_SORTED)
+        rsids = genome.intersect_rsid(genome)
+        self.assertEqual(len(rsids), len(genome))
+        self.assertEqual(genome.intersect_rsid(genome, 4), rsids)
+        self.assertEqual(genome.intersect_snp(self.genome, 0), rsids)
+        self.assertEqual(genome.intersect_rsid_count(genome, 4), len(rsids))
+        self.assertEqual(self.genome.intersect_snp_count(genome), len(rsids))
+
+    def test_internal_ids(self):
+        ids = self.genome.internal_ids
+        self.assertGreater(len(ids), 0)
+        self.assertEqual(self.genome.intersect_internal(self.genome), ids)
+
+        key = "i%d" % ids[0]
+        self.assertIn(key, self.genome)
+        self.assertEqual(self.genome[key].rsid, key)
+        self.assertNotIn("i1", self.genome)
+
+        genome = dt.parse_buffer("rs1\t1\t2\tAG\ni5\tX\t7\tT\n")
+        self.assertEqual(len(genome), 1)
+        self.assertEqual(genome.internal_ids, [5])
+        self.assertEqual(str(genome["i5"]), "T-")
+        self.assertEqual(genome.i5.chromosome, "X")
+
+    def test_find(self):
+        snps = self.genome.find("Y")
+        self.assertGreater(len(snps), 0)
+        self.assertTrue(all(snp.chromosome == "Y" for snp in snps))
+        positions = [snp.position for snp in snps]
+        self.assertEqual(positions, sorted(positions))
+
+        start, end = positions[len(positions)//4], positions[len(positions)//2]
+        expected = [s.rsid for s in snps if start <= s.position < end]
+        self.assertEqual([s.rsid for s in self.genome.find("Y", start, end)],
+                expected)
+
+        count = sum(len(self.genome.find(c)) for c in
+                range(1, 23) + ["MT", "X", "Y"])
+        self.assertLessEqual(count, len(self.genome))
+        self.assertEqual(self.genome.find(1, 10, 10), [])
+        self.assertRaises(ValueError, self.genome.find, 23)
+
     def test_orientation(self):
         self.assertIsInstance(self.genome.orientation, int)
         self.assertIn(self.genome.orientation, [-1,+1])